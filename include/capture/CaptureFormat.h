@@ -0,0 +1,76 @@
+#ifndef CAPTUREFORMAT_H
+#define CAPTUREFORMAT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// Protocol session capture, shared by the server-side recorder and the
+// iotropolis-replay tool.
+//
+// File:   "IOTC" | u16 version | u16 reserved | i64 start (epoch ms)
+// Record: u8 kind | u32 session | u64 time (us since start) | u32 length
+//         | payload
+// All integers little-endian. Inbound/Outbound payloads are single
+// protocol lines without the trailing newline; Open carries the peer
+// address. Credentials never reach the file: see redactSecrets().
+namespace CaptureFormat {
+
+constexpr quint16 Version          = 1;
+constexpr int     FileHeaderSize   = 16;
+constexpr int     RecordHeaderSize = 17;
+constexpr quint32 MaxPayload       = 16 * 1024 * 1024;
+
+enum class RecordKind : quint8
+{
+    Open     = 1,
+    Inbound  = 2,   // unit -> server
+    Outbound = 3,   // server -> unit
+    Close    = 4
+};
+
+struct Record
+{
+    RecordKind kind{RecordKind::Open};
+    quint32 session{0};
+    quint64 timeUs{0};
+    QByteArray payload;
+};
+
+// Stand-ins written instead of credentials; the replay tool substitutes
+// the secrets it knows or learns for SecretPlaceholder
+constexpr char SecretPlaceholder[] = "$IOTC_SECRET";
+constexpr char TokenPlaceholder[]  = "$IOTC_TOKEN";
+constexpr char RedactedPayload[]   = "$IOTC_REDACTED";
+
+// The line with the HELLO "secret", HELLO_ACK "identity_secret" and
+// DESCRIBE_ACK "session_token" values replaced by placeholders. Other
+// lines are returned as they are; a handshake line that is not a JSON
+// object keeps only its command.
+QByteArray redactSecrets(const QByteArray& line);
+
+void appendFileHeader(QByteArray* out, qint64 startEpochMs);
+void appendRecord(QByteArray* out, RecordKind kind, quint32 session,
+                  quint64 timeUs, const char* data, int length);
+
+// Sequential reader; a truncated final record (crash while writing) ends
+// the capture without an error
+class Reader
+{
+public:
+    bool open(const QString& path);
+
+    qint64 startEpochMs() const { return m_startEpochMs; }
+    QString errorString() const { return m_error; }
+
+    bool next(Record* record);
+
+private:
+    QFile m_file;
+    qint64 m_startEpochMs{0};
+    QString m_error;
+};
+
+} // namespace CaptureFormat
+
+#endif // CAPTUREFORMAT_H
@@ -0,0 +1,62 @@
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "capture/CaptureFormat.h"
+
+// Records unit protocol traffic into a capture file (see CaptureFormat.h).
+//
+// record() only appends to an in-memory buffer; a background thread
+// swaps it out and writes it. If the disk falls behind by more than
+// MaxPendingBytes, further records are dropped and counted rather than
+// stalling the server.
+class SessionRecorder
+{
+public:
+    static constexpr int MaxPendingBytes = 64 * 1024 * 1024;
+    static constexpr int FlushIntervalMs = 200;
+
+    SessionRecorder() = default;
+    ~SessionRecorder();
+
+    bool start(const QString& path);
+    void stop();
+
+    bool isRecording() const { return m_thread != nullptr; }
+
+    // New session id; records an Open with the peer address
+    quint32 openSession(const QString& peerAddress);
+
+    void record(CaptureFormat::RecordKind kind, quint32 session,
+                const char* data, int length);
+    void record(CaptureFormat::RecordKind kind, quint32 session,
+                const QByteArray& data)
+    { record(kind, session, data.constData(), data.size()); }
+
+    quint64 droppedRecords() const;
+
+    // Records waiting for the writer thread
+    qint64 memoryBytes() const;
+
+private:
+    void writerLoop();
+
+    QString m_path;
+    QElapsedTimer m_clock;
+    quint32 m_nextSession{1};
+
+    QThread* m_thread{nullptr};
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QByteArray m_pending;
+    quint64 m_dropped{0};
+    bool m_running{false};
+};
+
+#endif // SESSIONRECORDER_H
@@ -1,5 +1,9 @@
 #pragma once
+#include <QByteArray>
 #include <QString>
+#include <QStringList>
+
+#include "registration/AdmissionSettings.h"
 
 class IoTropolisConfig
 {
@@ -11,6 +15,42 @@ public:
     QString bindAddress() const;
     QString unitTypeDir() const;
     bool guiEnabled() const;
+    QString transport() const;      // "qt" or "epoll"
+    AdmissionSettings admission() const;
+    int rawSamplesPerSensor() const;
+    int windowsPerResolution() const;
+    int retentionSec() const;       // history of disconnected units
+    int maxRetainedUnits() const;
+    bool queryEnabled() const;
+    QString querySocket() const;
+    int queryWorkers() const;
+    bool persistenceEnabled() const;
+    QString stateDir() const;
+    int snapshotIntervalSec() const;
+    bool replicationEnabled() const;
+    quint8 nodeID() const;
+    quint16 replicationPort() const;
+    QStringList replicationPeers() const;
+    QString replicationBindAddress() const;     // server/bind_address if unset
+    QByteArray replicationSecret() const;       // shared by all nodes
+    bool udpEnabled() const;
+    quint16 udpPort() const;
+    int udpThreads() const;
+    bool captureEnabled() const;
+    QString captureFile() const;
+    QString loggingRules() const;   // QLoggingCategory filter rules
+    int metricsIntervalSec() const;
+    bool metricsLog() const;
+
+    // Reject values the subsystems cannot work with
+    bool validate(QString* error) const;
+
+    // Settings that differ from 'previous' but only take effect on restart
+    QStringList restartRequiredChanges(const IoTropolisConfig& previous) const;
+
+    // This configuration with every restart-only setting taken from
+    // 'running': what a live reload actually applies
+    IoTropolisConfig withRestartSettingsOf(const IoTropolisConfig& running) const;
 
     // Default location for INI file
     static QString defaultConfigPath();
@@ -23,4 +63,30 @@ private:
     QString m_bindAddress;
     QString m_unitTypeDir;
     bool m_guiEnabled;
+    QString m_transport;
+    AdmissionSettings m_admission;
+    int m_rawSamplesPerSensor;
+    int m_windowsPerResolution;
+    int m_retentionSec;
+    int m_maxRetainedUnits;
+    bool m_queryEnabled;
+    QString m_querySocket;
+    int m_queryWorkers;
+    bool m_persistenceEnabled;
+    QString m_stateDir;
+    int m_snapshotIntervalSec;
+    bool m_replicationEnabled;
+    quint8 m_nodeID;
+    quint16 m_replicationPort;
+    QStringList m_replicationPeers;
+    QString m_replicationBindAddress;
+    QByteArray m_replicationSecret;
+    bool m_udpEnabled;
+    quint16 m_udpPort;
+    int m_udpThreads;
+    bool m_captureEnabled;
+    QString m_captureFile;
+    QString m_loggingRules;
+    int m_metricsIntervalSec;
+    bool m_metricsLog;
 };
@@ -0,0 +1,53 @@
+#ifndef IOTROPOLISCONFIGRELOADER_H
+#define IOTROPOLISCONFIGRELOADER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+
+#include <memory>
+
+#include "config/IoTropolisConfig.h"
+
+// A published configuration is never modified; a reload builds a new one
+using IoTropolisConfigPtr = std::shared_ptr<const IoTropolisConfig>;
+
+// Re-reads the INI file on SIGHUP or on request and, if the new settings
+// validate, swaps them in and tells subsystems to apply the difference.
+// Restart-only settings keep their running values in current() until the
+// process restarts. current() may be called from any thread.
+class IoTropolisConfigReloader : public QObject
+{
+    Q_OBJECT
+public:
+    IoTropolisConfigReloader(const QString& path, IoTropolisConfigPtr initial,
+                             QObject* parent = nullptr);
+    ~IoTropolisConfigReloader() override;
+
+    IoTropolisConfigPtr current() const;
+
+    // Keeps the current configuration and fills *error on failure
+    bool reload(QString* error = nullptr);
+
+    // Restart-only settings the file changed since startup
+    QStringList pendingRestart() const { return m_pendingRestart; }
+
+    // Reload on SIGHUP (Unix only); the signal is forwarded through a
+    // socket pair so the reload itself runs on this object's thread
+    bool watchSighup();
+
+signals:
+    // Emitted after the swap, on this object's thread
+    void configChanged(const IoTropolisConfigPtr& config,
+                       const IoTropolisConfigPtr& previous);
+
+private slots:
+    void onSignalPipe();
+
+private:
+    QString m_path;
+    IoTropolisConfigPtr m_current;
+    QStringList m_pendingRestart;
+    QSocketNotifier* m_notifier{nullptr};
+};
+
+#endif // IOTROPOLISCONFIGRELOADER_H
@@ -3,7 +3,9 @@
 
 #include <QMainWindow>
 #include <QTableWidget>
+#include <QLabel>
 #include "registration/IoTropolisUnitConnection.h"
+#include "metrics/MemoryStats.h"
 
 class IoTropolisGui : public QMainWindow
 {
@@ -11,17 +13,31 @@ class IoTropolisGui : public QMainWindow
 public:
     explicit IoTropolisGui(QWidget *parent = nullptr);
 
+    // Approximate heap held by the unit table items
+    qint64 memoryBytes() const { return m_itemBytes; }
+
 public slots:
     void addUnit(IoTropolisUnitConnection* unit);
     void removeUnit(IoTropolisUnitConnection* unit);
+    void showMemoryReport(const MemoryReport& report);
+
+signals:
+    // Answered synchronously with showMemoryReport()
+    void memoryReportRequested();
 
 private slots:
     void showAboutDialog();
+    void showMemoryDialog();
 
 private:
     QTableWidget* unitTable;
+    QLabel* memoryLabel;
+
+    MemoryReport m_lastReport;
+    qint64 m_itemBytes{0};
 
     int findRowByUnitID(UnitID id) const;
+    qint64 rowBytes(int row) const;
     void createMenus();
 };
 
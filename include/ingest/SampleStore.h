@@ -0,0 +1,161 @@
+#ifndef SAMPLESTORE_H
+#define SAMPLESTORE_H
+
+#include <QHash>
+#include <QMultiMap>
+#include <QStringList>
+#include <QVector>
+#include <QReadWriteLock>
+
+#include <algorithm>
+
+#include "ingest/SensorSample.h"
+#include "ingest/SensorAggregator.h"
+
+// Bounded in-memory sensor history: the most recent raw samples of every
+// series plus the closed rollup windows of every aggregation resolution.
+// Appended from the server thread, read concurrently by query workers.
+class SampleStore
+{
+public:
+    struct RawPoint
+    {
+        qint64 timestampMs;
+        double value;
+    };
+
+    static constexpr int DefaultRawCapacity    = 4096;
+    static constexpr int DefaultWindowCapacity = 1440;
+
+    // History of disconnected units is kept this long, for at most this
+    // many units (oldest disconnect evicted first)
+    static constexpr qint64 DefaultRetentionMs      = 3600 * 1000;
+    static constexpr int    DefaultMaxRetainedUnits = 1024;
+
+    explicit SampleStore(int rawCapacity = DefaultRawCapacity,
+                         int windowCapacity = DefaultWindowCapacity);
+
+    // Existing series are resized in place, keeping their newest entries
+    void setCapacity(int rawCapacity, int windowCapacity);
+    void setRetention(qint64 retentionMs, int maxRetainedUnits);
+
+    void appendSamples(const SensorSample* samples, int count);
+    void appendSamples(const SensorSampleBatch& batch) { appendSamples(batch.constData(), batch.size()); }
+    void appendWindows(const ClosedWindowBatch& windows);
+
+    // Cursor-based range reads, so callers can stream a range in chunks
+    // while ingest keeps appending. Start with cursor 0 and pass the
+    // returned cursor to the next call; the range is exhausted once a call
+    // returns no entries.
+    quint64 readRaw(UnitID unitID, quint16 sensorIndex,
+                    qint64 fromMs, qint64 toMs,
+                    quint64 cursor, int maxPoints,
+                    QVector<RawPoint>* out) const;
+
+    quint64 readWindows(UnitID unitID, quint16 sensorIndex, qint64 resolutionMs,
+                        qint64 fromMs, qint64 toMs,
+                        quint64 cursor, int maxWindows,
+                        QVector<ClosedWindow>* out) const;
+
+    // Sensor names of every registered unit. Samples of units that were
+    // never described are not stored. A unit re-registering with a
+    // different sensor list loses its old series.
+    void describeUnit(UnitID unitID, const QStringList& sensorNames);
+    bool containsUnit(UnitID unitID) const;
+    int sensorIndex(UnitID unitID, const QString& sensorName) const;
+
+    // The unit disconnected: its names and series stay addressable until
+    // the retention age or the retained-unit cap evicts them, or until it
+    // is described again
+    void releaseUnit(UnitID unitID, qint64 nowMs);
+    void expire(qint64 nowMs);
+
+    int seriesCount() const;
+    int retainedUnitCount() const;
+    quint64 evictedUnits() const;
+
+    // Rings grow on demand, so these follow what was actually stored.
+    // memoryBytes() covers connected units, retainedMemoryBytes() the
+    // disconnected units still retained.
+    qint64 memoryBytes() const;
+    qint64 retainedMemoryBytes() const;
+
+private:
+    // Bounded ring, oldest entry overwritten first. The buffer doubles up
+    // to 'capacity' as entries arrive and only wraps once it is full, so a
+    // series that reports rarely stays small. 'pushed' counts every entry
+    // ever appended and gives entries stable sequence numbers.
+    template <typename T>
+    struct Ring
+    {
+        static constexpr int MinSize = 16;
+
+        QVector<T> buf;
+        int capacity{0};
+        int head{0};
+        int size{0};
+        quint64 pushed{0};
+
+        void push(const T& v)
+        {
+            // Not wrapped yet (head == 0): entries are buf[0, size)
+            if (size == buf.size() && buf.size() < capacity)
+                buf.resize(std::min(capacity, std::max(MinSize, int(buf.size()) * 2)));
+
+            buf[(head + size) % buf.size()] = v;
+            if (size < buf.size())
+                ++size;
+            else
+                head = (head + 1) % buf.size();
+            ++pushed;
+        }
+        const T& at(int i) const { return buf[(head + i) % buf.size()]; }
+
+        // Sequence numbers stay valid; dropped entries read as evicted
+        void resize(int newCapacity)
+        {
+            capacity = newCapacity;
+            if (buf.size() <= newCapacity && head == 0)
+                return;
+            const int keep = std::min(size, newCapacity);
+            QVector<T> next(keep);
+            for (int i = 0; i < keep; ++i)
+                next[i] = at(size - keep + i);
+            buf.swap(next);
+            head = 0;
+            size = keep;
+        }
+    };
+
+    template <typename T, typename TimeOf>
+    static quint64 readRing(const Ring<T>& ring, qint64 fromMs, qint64 toMs,
+                            quint64 cursor, int max, QVector<T>* out, TimeOf timeOf);
+
+    static quint64 seriesKey(UnitID unitID, quint16 sensorIndex)
+    {
+        return (quint64(unitID) << 16) | sensorIndex;
+    }
+    static int resolutionIndex(qint64 resolutionMs);
+
+    void dropSeriesLocked(UnitID unitID, int sensorCount);
+    void evictOldestLocked();
+    qint64 bytesOf(bool retained) const;
+
+    mutable QReadWriteLock m_lock;
+
+    int m_rawCapacity;
+    int m_windowCapacity;
+    qint64 m_retentionMs{DefaultRetentionMs};
+    int m_maxRetainedUnits{DefaultMaxRetainedUnits};
+
+    QHash<quint64, Ring<RawPoint>> m_raw;
+    QHash<quint64, Ring<ClosedWindow>> m_windows[SensorAggregator::ResolutionCount];
+    QHash<UnitID, QStringList> m_sensorNames;
+
+    // Disconnected units by release time, oldest first
+    QMultiMap<qint64, UnitID> m_released;
+    QHash<UnitID, qint64> m_releasedAt;
+    quint64 m_evictedUnits{0};
+};
+
+#endif // SAMPLESTORE_H
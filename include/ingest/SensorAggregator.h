@@ -0,0 +1,148 @@
+#ifndef SENSORAGGREGATOR_H
+#define SENSORAGGREGATOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+
+#include <limits>
+#include <vector>
+
+#include "ingest/SensorSample.h"
+
+// Incremental min/max/mean/count rollups on the ingest path.
+//
+// Every (unit, sensor) series owns one slot. Window state is kept as
+// struct-of-arrays (one vector per field, indexed by slot) so batch updates
+// and expiry scans walk contiguous memory. Tumbling windows are kept at 1s,
+// 1m and 1h; a sliding 1m view is assembled from a ring of 1s panes.
+class SensorAggregator : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int ResolutionCount = 3;
+    static constexpr qint64 Resolutions[ResolutionCount] = {1000, 60000, 3600000};
+
+    static constexpr int SlidingPanes = 60;
+    static constexpr qint64 SlidingWidthMs = SlidingPanes * 1000;
+
+    // Windows are closed by flushExpired() only once they are this old,
+    // so slightly out-of-order samples still land in the right window.
+    static constexpr qint64 FlushGraceMs = 1000;
+
+    // A dropped series remembers its last closed windows this long, so a
+    // unit that reconnects cannot reopen (and re-emit) a window
+    static constexpr qint64 ClosedMarkRetentionMs = 2 * 3600000;
+
+    struct WindowStats
+    {
+        quint64 count{0};
+        double min{0.0};
+        double max{0.0};
+        double mean{0.0};
+    };
+
+    explicit SensorAggregator(QObject* parent = nullptr);
+
+    // Samples of the same series should be adjacent and in time order;
+    // consecutive samples of one series in one second are reduced together.
+    void ingest(const SensorSample* samples, int count);
+    void ingest(const SensorSampleBatch& batch) { ingest(batch.constData(), batch.size()); }
+
+    // Close every window that ended more than FlushGraceMs before nowMs
+    void flushExpired(qint64 nowMs);
+
+    // Close the unit's open windows and release its series slots; the
+    // series' closed marks are kept for ClosedMarkRetentionMs
+    void dropUnit(UnitID unitID);
+
+    // Sliding SlidingWidthMs view ending at nowMs
+    WindowStats sliding(UnitID unitID, quint16 sensorIndex, qint64 nowMs) const;
+
+    int seriesCount() const { return m_seriesIndex.size(); }
+    quint64 lateSamples() const { return m_lateSamples; }
+
+    // Reserved capacity of the slot arrays, indexes and buffers
+    qint64 memoryBytes() const;
+
+signals:
+    // Emitted once per ingest/flush call with every window it closed
+    void windowsClosed(const ClosedWindowBatch& windows);
+
+private:
+    // One tumbling resolution, struct-of-arrays indexed by series slot.
+    // count == 0 means the slot has no open window; closed holds the start
+    // of the last window emitted for the series, also across dropUnit(),
+    // so it never reopens.
+    struct WindowBank
+    {
+        qint64 widthMs{0};
+        std::vector<qint64>  start;
+        std::vector<qint64>  closed;
+        std::vector<quint64> count;
+        std::vector<double>  sum;
+        std::vector<double>  min;
+        std::vector<double>  max;
+    };
+
+    // Closed 1s panes feeding the sliding view, SlidingPanes per slot
+    struct PaneRing
+    {
+        std::vector<qint64>  start;
+        std::vector<quint64> count;
+        std::vector<double>  sum;
+        std::vector<double>  min;
+        std::vector<double>  max;
+    };
+
+    // Last emitted window start per resolution of a dropped series
+    struct ClosedMarks
+    {
+        qint64 start[ResolutionCount];
+    };
+
+    struct BatchStats
+    {
+        double sum;
+        double min;
+        double max;
+    };
+
+    static quint64 seriesKey(UnitID unitID, quint16 sensorIndex)
+    {
+        return (quint64(unitID) << 16) | sensorIndex;
+    }
+
+    static constexpr qint64 NoWindow = std::numeric_limits<qint64>::min();
+
+    static BatchStats reduceBatch(const double* values, int n);
+
+    int slotFor(UnitID unitID, quint16 sensorIndex);
+    void accumulate(WindowBank& bank, int slot, qint64 windowStart,
+                    const BatchStats& stats, quint64 n);
+    void closeWindow(int bankIndex, int slot);
+    void emitPending();
+    void pruneClosedMarks(qint64 nowMs);
+
+    WindowBank m_banks[ResolutionCount];
+    PaneRing m_panes;
+
+    QHash<quint64, int> m_seriesIndex;
+    QHash<UnitID, QVector<int>> m_unitSlots;
+    std::vector<quint64> m_slotKey;
+    std::vector<int> m_freeSlots;
+
+    // Marks of dropped series, reclaimed by their slot when the series
+    // comes back. Once pruned, m_closedFloor stands in for them: no new
+    // series opens a window at or before it.
+    QHash<quint64, ClosedMarks> m_closedMarks;
+    qint64 m_closedFloor{NoWindow};
+    qint64 m_nextMarkPruneMs{0};
+
+    std::vector<double> m_scratch;
+    ClosedWindowBatch m_pending;
+
+    quint64 m_lateSamples{0};
+};
+
+#endif // SENSORAGGREGATOR_H
@@ -0,0 +1,49 @@
+#ifndef SENSORSAMPLE_H
+#define SENSORSAMPLE_H
+
+#include <QtGlobal>
+#include <QMetaType>
+#include <QVector>
+
+#include "registration/UnitID.h"
+
+// A single reading of one declared sensor. The sensor is addressed by its
+// index in the unit's DESCRIBE sensor list, not by name, so the ingest path
+// never touches strings.
+struct SensorSample
+{
+    UnitID  unitID{0};
+    quint16 sensorIndex{0};
+    qint64  timestampMs{0};
+    double  value{0.0};
+};
+
+// One closed aggregation window (min/max/mean/count) of a sensor series
+struct ClosedWindow
+{
+    UnitID  unitID{0};
+    quint16 sensorIndex{0};
+    qint64  resolutionMs{0};
+    qint64  startMs{0};
+    quint64 count{0};
+    double  min{0.0};
+    double  max{0.0};
+    double  mean{0.0};
+};
+
+// Accepted sample timestamps: the epoch up to the end of year 9999. Keeps
+// window arithmetic clear of overflow and negative window starts.
+constexpr qint64 MaxSampleTimestampMs = Q_INT64_C(253402300799999);
+
+inline bool isValidSampleTimestamp(qint64 timestampMs)
+{
+    return timestampMs >= 0 && timestampMs <= MaxSampleTimestampMs;
+}
+
+using SensorSampleBatch = QVector<SensorSample>;
+using ClosedWindowBatch = QVector<ClosedWindow>;
+
+Q_DECLARE_METATYPE(SensorSample)
+Q_DECLARE_METATYPE(ClosedWindow)
+
+#endif // SENSORSAMPLE_H
@@ -0,0 +1,36 @@
+#ifndef UDPSESSIONTABLE_H
+#define UDPSESSIONTABLE_H
+
+#include <QHash>
+#include <QVector>
+#include <QReadWriteLock>
+
+#include "registration/IOComponent.h"
+#include "registration/UnitID.h"
+
+// Units allowed to send sample datagrams: the session token issued in
+// their DESCRIBE_ACK and the value kind of each declared sensor.
+// Written from the server thread, read by the UDP receive threads.
+class UdpSessionTable
+{
+public:
+    struct Session
+    {
+        quint64 token{0};
+        QVector<IOComponent::ValueKind> sensorKinds;
+    };
+
+    void insert(UnitID unitID, const Session& session);
+    void remove(UnitID unitID);
+
+    // Copies the session out if the token matches
+    bool lookup(UnitID unitID, quint64 token, Session* out) const;
+
+    int size() const;
+
+private:
+    mutable QReadWriteLock m_lock;
+    QHash<UnitID, Session> m_sessions;
+};
+
+#endif // UDPSESSIONTABLE_H
@@ -0,0 +1,56 @@
+#ifndef MEMORYMONITOR_H
+#define MEMORYMONITOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include <functional>
+
+#include "metrics/MemoryStats.h"
+
+// Collects memory accounting from the subsystems that registered a size
+// provider. Providers are polled on this object's thread, only when a
+// report is requested or the metrics timer fires, so accounting costs
+// nothing on the hot paths beyond the counters the subsystems keep.
+class MemoryMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int DefaultTopConnections = 10;
+    static constexpr int MaxTopConnections = 1000;
+
+    using SizeProvider = std::function<qint64()>;
+
+    // Fills connectionCount, connectionBytes and the topN heaviest connections
+    using ConnectionProvider = std::function<void(int topN, MemoryReport* report)>;
+
+    explicit MemoryMonitor(QObject* parent = nullptr);
+
+    void addSubsystem(const QByteArray& name, SizeProvider provider);
+    void setConnectionProvider(ConnectionProvider provider);
+
+    MemoryReport collect(int topN = DefaultTopConnections) const;
+
+    // Emit reportReady() every intervalSec (0 stops)
+    void setInterval(int intervalSec);
+
+signals:
+    void reportReady(const MemoryReport& report);
+
+private slots:
+    void onTimer();
+
+private:
+    struct Provider
+    {
+        QByteArray name;
+        SizeProvider size;
+    };
+
+    QVector<Provider> m_providers;
+    ConnectionProvider m_connections;
+    QTimer m_timer;
+};
+
+#endif // MEMORYMONITOR_H
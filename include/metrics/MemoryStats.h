@@ -0,0 +1,64 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "registration/IOComponent.h"
+#include "registration/UnitID.h"
+
+// Approximate heap footprint of Qt values. Qt containers cannot take a
+// custom allocator, so subsystems account for what they hold with these
+// estimates (header + reserved capacity) at the points where it changes.
+// Implicitly shared data is counted by every holder.
+namespace MemoryStats {
+
+constexpr qint64 ArrayHeader      = 24;     // QArrayData / QListData header
+constexpr qint64 HashNodeOverhead = 24;     // next pointer, hash, alignment
+constexpr qint64 QObjectOverhead  = 128;    // QObjectPrivate, no connections
+
+qint64 bytes(const QString& s);
+qint64 bytes(const QByteArray& b);
+qint64 bytes(const IOComponent& c);         // excluding sizeof(IOComponent)
+qint64 bytes(const QList<IOComponent>& list);
+
+} // namespace MemoryStats
+
+// One collection of every subsystem's footprint
+struct MemoryReport
+{
+    struct Subsystem
+    {
+        QByteArray name;
+        qint64 bytes{0};
+    };
+
+    struct Connection
+    {
+        UnitID unitID{0};
+        QString ipAddress;
+        qint64 bytes{0};
+    };
+
+    qint64 collectedAtMs{0};
+    QVector<Subsystem> subsystems;
+
+    int connectionCount{0};
+    qint64 connectionBytes{0};
+    QVector<Connection> topConnections;     // heaviest first
+
+    qint64 totalBytes() const;
+
+    // Query endpoint rows ("MEM", "CONN") terminated by "END <rows>"
+    QByteArray toQueryRows() const;
+
+    // Prometheus text exposition format
+    QByteArray toPrometheus() const;
+
+    // One line for the log
+    QString summary() const;
+};
+
+#endif // MEMORYSTATS_H
@@ -0,0 +1,66 @@
+#ifndef REGISTRYPERSISTENCE_H
+#define REGISTRYPERSISTENCE_H
+
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+#include <memory>
+
+#include "registration/UnitRegistry.h"
+
+// Warm-restart state for the unit registry: the UnitID allocator, the
+// identity -> UnitID table and the hashes of the identity secrets.
+//
+// <dir>/registry.snapshot  full state as of a delta sequence number
+// <dir>/registry.journal   length-prefixed deltas appended after it
+//
+// Deltas are appended and fsync'ed on the mutating thread before the
+// registry hands out the UnitID or secret they record, so nothing reaches
+// a unit that a crash could forget. They are rare: one IdsReserved per
+// IdReserveBlock allocations and one IdentityBound per new identity.
+// A background thread periodically writes a new snapshot (from a
+// copy-on-write registry view) before truncating the journal.
+class RegistryPersistence
+{
+public:
+    RegistryPersistence(UnitRegistry* registry, const QString& dir);
+    ~RegistryPersistence();
+
+    // Load snapshot and replay journal into the registry. Call before start().
+    // False if existing state could not be read; start() would then
+    // overwrite it, so the caller must not start.
+    bool restore();
+
+    void start(int snapshotIntervalSec);
+    void stop();
+
+private:
+    void onDelta(const RegistryDelta& delta);
+    void writerLoop();
+
+    bool appendJournal(const RegistryDelta& delta);
+    bool writeSnapshot();
+
+    QString snapshotPath() const;
+    QString journalPath() const;
+
+    UnitRegistry* m_registry{nullptr};
+    QString m_dir;
+    int m_snapshotIntervalMs{60000};
+
+    QThread* m_thread{nullptr};
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    bool m_running{false};
+
+    // Serializes journal appends with the post-snapshot truncation
+    QMutex m_journalMutex;
+    quint64 m_journaledSeq{0};
+
+    // Registry listeners cannot be removed; they reach us through this
+    std::shared_ptr<RegistryPersistence*> m_self;
+};
+
+#endif // REGISTRYPERSISTENCE_H
@@ -0,0 +1,117 @@
+#ifndef IOTROPOLISQUERYSERVER_H
+#define IOTROPOLISQUERYSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThreadPool>
+#include <QQueue>
+#include <QSet>
+#include <QHash>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class UnitRegistry;
+class SampleStore;
+class QueryTask;
+
+// Control command handler: runs on the server thread with the text after
+// the command word and returns the complete response
+using QueryControlHandler = std::function<QByteArray(const QByteArray& args)>;
+using QueryControlCommands = QHash<QByteArray, QueryControlHandler>;
+
+// State shared between a session and the worker running its query
+struct QueryState
+{
+    std::atomic<bool> cancelled{false};
+    std::atomic<qint64> pendingBytes{0};
+};
+
+// One client of the query endpoint. Requests are answered one at a time,
+// in order; results arrive from the worker pool as queued chunks. A client
+// that pipelines too many requests ahead of its answers is disconnected.
+class IoTropolisQuerySession : public QObject
+{
+    Q_OBJECT
+public:
+    IoTropolisQuerySession(QLocalSocket* socket,
+                           const UnitRegistry* registry,
+                           const SampleStore* store,
+                           QThreadPool* pool,
+                           const QueryControlCommands* controls,
+                           QObject* parent = nullptr);
+
+    // Called (queued) by the worker
+    void writeChunk(const QByteArray& chunk);
+    void queryPaused();
+    void queryFinished();
+
+    void cancel();
+
+private slots:
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+
+private:
+    void startNext();
+    void resumeTask();
+
+    QLocalSocket* m_socket{nullptr};
+    const UnitRegistry* m_registry{nullptr};
+    const SampleStore* m_store{nullptr};
+    QThreadPool* m_pool{nullptr};
+    const QueryControlCommands* m_controls{nullptr};
+
+    std::shared_ptr<QueryState> m_state;
+    std::shared_ptr<QueryTask> m_task;      // running or paused query
+    QQueue<QByteArray> m_requests;
+    bool m_busy{false};
+    bool m_paused{false};
+    bool m_closing{false};
+};
+
+// Local (Unix socket) query service over the unit registry and sample store.
+//
+// Request: one line, "<COMMAND> key=value ...". Response: zero or more
+// rows followed by "END <rows>", or a single "ERROR <reason>" line.
+//
+//   UNITS   [type=<type>] [sensor=<name>]
+//   SAMPLES unit=<id> sensor=<name> [last=<s>] [from=<ms>] [to=<ms>]
+//   ROLLUP  unit=<id> sensor=<name> res=1s|1m|1h [last=<s>] [from=<ms>] [to=<ms>]
+//
+// Control commands registered with addControlCommand() (e.g. RELOAD) run
+// on the server thread instead of the worker pool.
+class IoTropolisQueryServer : public QObject
+{
+    Q_OBJECT
+public:
+    IoTropolisQueryServer(const UnitRegistry* registry,
+                          const SampleStore* store,
+                          QObject* parent = nullptr);
+    ~IoTropolisQueryServer() override;
+
+    bool start(const QString& socketName, int workerThreads);
+
+    void setWorkerCount(int workerThreads);
+
+    // 'name' is matched case-insensitively
+    void addControlCommand(const QByteArray& name, QueryControlHandler handler);
+
+private slots:
+    void onNewConnection();
+
+private:
+    QLocalServer* m_server{nullptr};
+    QThreadPool m_pool;
+    QueryControlCommands m_controls;
+
+    const UnitRegistry* m_registry{nullptr};
+    const SampleStore* m_store{nullptr};
+
+    QSet<IoTropolisQuerySession*> m_sessions;
+};
+
+#endif // IOTROPOLISQUERYSERVER_H
@@ -0,0 +1,56 @@
+#ifndef ADMISSIONCONTROLLER_H
+#define ADMISSIONCONTROLLER_H
+
+#include <QHash>
+#include <QString>
+
+#include "registration/AdmissionSettings.h"
+
+// Connection admission at accept time.
+//
+// Every new connection takes one token from its source IP's bucket and one
+// from the global bucket; when either is empty the unit is told to come
+// back later (RETRY_AFTER in reply to HELLO). Independently, the number of
+// connections that are still handshaking is capped; at the cap the server
+// stops accepting and leaves new connections in the (bounded) backlog.
+class AdmissionController
+{
+public:
+    explicit AdmissionController(const AdmissionSettings& settings = AdmissionSettings());
+
+    void setSettings(const AdmissionSettings& settings);
+    const AdmissionSettings& settings() const { return m_settings; }
+
+    // True if a connection from 'ip' may handshake now. Otherwise
+    // *retryAfterMs is when its tokens will be available again.
+    bool admit(const QString& ip, qint64 nowMs, int* retryAfterMs);
+
+    // Handshake slots
+    bool atHandshakeCap() const { return m_inHandshake >= m_settings.maxInHandshake; }
+    void handshakeStarted()  { ++m_inHandshake; }
+    void handshakeFinished() { if (m_inHandshake > 0) --m_inHandshake; }
+    int inHandshake() const  { return m_inHandshake; }
+
+    quint64 rejected() const { return m_rejected; }
+
+private:
+    struct Bucket
+    {
+        double tokens{0.0};
+        qint64 lastMs{0};
+    };
+
+    static void refill(Bucket& b, double rate, double burst, qint64 nowMs);
+    static int waitMs(const Bucket& b, double rate);
+    void pruneIdle(qint64 nowMs);
+
+    AdmissionSettings m_settings;
+    QHash<QString, Bucket> m_perIp;
+    Bucket m_global;
+    qint64 m_nextGlobalSlotMs{0};
+    int m_inHandshake{0};
+    quint64 m_rejected{0};
+    qint64 m_lastPruneMs{0};
+};
+
+#endif // ADMISSIONCONTROLLER_H
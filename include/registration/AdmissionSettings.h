@@ -0,0 +1,26 @@
+#ifndef ADMISSIONSETTINGS_H
+#define ADMISSIONSETTINGS_H
+
+// Limits applied by AdmissionController; plain data so the configuration
+// can carry them without pulling in the controller
+struct AdmissionSettings
+{
+    double perIpRate{5.0};          // tokens per second
+    double perIpBurst{20.0};
+    double globalRate{500.0};
+    double globalBurst{1000.0};
+    int maxInHandshake{256};
+    int acceptBacklog{1024};
+    int handshakeTimeoutMs{10000};
+
+    bool operator==(const AdmissionSettings& o) const
+    {
+        return perIpRate == o.perIpRate && perIpBurst == o.perIpBurst &&
+               globalRate == o.globalRate && globalBurst == o.globalBurst &&
+               maxInHandshake == o.maxInHandshake && acceptBacklog == o.acceptBacklog &&
+               handshakeTimeoutMs == o.handshakeTimeoutMs;
+    }
+    bool operator!=(const AdmissionSettings& o) const { return !(*this == o); }
+};
+
+#endif // ADMISSIONSETTINGS_H
@@ -0,0 +1,87 @@
+#ifndef HANDSHAKEPARSER_H
+#define HANDSHAKEPARSER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+#include <vector>
+
+#include "registration/IOComponent.h"
+
+// Single-pass JSON reader for the HELLO and DESCRIBE payloads.
+//
+// Reads straight from the line buffer without building a DOM. Strings
+// without escapes are referenced in place; escaped ones are decoded into
+// a scratch arena owned by the parser (one per connection) and reused
+// between messages. Type names, component names and formats are interned,
+// so units of the same type share their strings.
+//
+// Results match the QJsonDocument-based parsing this replaces: a payload
+// that is not a well-formed JSON object (including malformed UTF-8) reads
+// as {}, values of the wrong type read as empty strings / empty lists, and
+// the last of duplicate keys wins. QJsonDocument's leniencies are kept:
+// raw control bytes in strings, unknown escapes taken literally, unpaired
+// \u surrogates preserved, and numbers as QByteArray::toDouble reads them.
+class HandshakeParser
+{
+public:
+    enum class Result { Ok, InvalidSensor, InvalidActuator };
+
+    // HELLO {"version":"1.0"[,"identity":"...","secret":"..."]}
+    // false unless version is "1.0"
+    bool parseHello(const QByteArray& data, QString* identity, QString* secret);
+
+    // DESCRIBE {"type","subtype","sensors":[{"name","format"}...],"actuators":[...]}
+    // Components need a non-empty string name and format.
+    Result parseDescribe(const QByteArray& data,
+                         QString* unitType, QString* unitSubtype,
+                         QList<IOComponent>* sensors,
+                         QList<IOComponent>* actuators);
+
+    // Free the arena once the handshake is over
+    void release();
+
+    qint64 memoryBytes() const { return qint64(m_arena.capacity()); }
+
+private:
+    static constexpr int MaxDepth = 1024;     // QJsonDocument's nesting limit
+
+    // A decoded string: in the input (no escapes) or in the arena
+    struct Text
+    {
+        bool isString{false};
+        bool inArena{false};
+        bool hasSurrogates{false};  // unpaired \u surrogates, not valid UTF-8
+        int offset{0};
+        int length{0};
+    };
+
+    void begin(const QByteArray& data);
+    bool atEnd();
+
+    void skipWs();
+    bool consume(char c);
+    bool peek(char c);
+
+    bool parseString(Text* out);
+    bool parseValueText(Text* out, int depth);    // non-strings give !isString
+    bool skipValue(int depth);
+    bool skipNumber();
+    bool skipLiteral(const char* literal, int length);
+
+    bool parseComponents(QList<IOComponent>* list, bool* valid, int depth);
+    bool parseComponent(QList<IOComponent>* list, bool* valid, int depth);
+
+    const char* textData(const Text& t) const;
+    bool textEquals(const Text& t, const char* literal, int length) const;
+    QString textString(const Text& t) const;
+    QString internText(const Text& t) const;
+
+    const char* m_begin{nullptr};
+    const char* m_p{nullptr};
+    const char* m_end{nullptr};
+    std::vector<char> m_arena;
+};
+
+#endif // HANDSHAKEPARSER_H
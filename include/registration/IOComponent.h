@@ -7,6 +7,9 @@
 class IOComponent
 {
 public:
+    // How sample values of this component are interpreted
+    enum class ValueKind { Unknown, Bool, Integer, Real };
+
     IOComponent() = default;
     IOComponent(const QString& name, const QString& format)
         : m_name(name), m_format(format) {}
@@ -16,6 +19,12 @@ public:
 
     bool isValid() const { return !m_name.isEmpty() && !m_format.isEmpty(); }
 
+    // Numeric kind derived from the declared format ("float", "int16", ...)
+    ValueKind valueKind() const { return valueKindForFormat(m_format); }
+    bool isNumeric() const { return valueKind() != ValueKind::Unknown; }
+
+    static ValueKind valueKindForFormat(const QString& format);
+
     // JSON helpers
     static IOComponent fromJson(const QJsonObject& obj, bool* ok = nullptr);
     QJsonObject toJson() const;
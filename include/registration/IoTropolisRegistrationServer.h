@@ -4,17 +4,71 @@
 #include <QObject>
 #include <QTcpServer>
 #include <QSet>
+#include <QHash>
+#include <QMultiMap>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include "registration/IoTropolisUnitConnection.h"
+#include "registration/UnitConnectionObserver.h"
+#include "registration/UnitRegistry.h"
+#include "registration/UnitTypeCatalog.h"
+#include "registration/AdmissionController.h"
+#include "ingest/SensorAggregator.h"
+#include "ingest/SampleStore.h"
+#include "capture/SessionRecorder.h"
+#include "ingest/UdpSessionTable.h"
+#include "metrics/MemoryStats.h"
+#include "transport/EpollUnitListener.h"
+#include "transport/UdpIngestListener.h"
 
-class IoTropolisRegistrationServer : public QObject
+class IoTropolisRegistrationServer : public QObject, public UnitConnectionObserver
 {
     Q_OBJECT
 public:
 //    explicit IoTropolisRegistrationServer(QObject* parent = nullptr);
     explicit IoTropolisRegistrationServer(const QString& unitTypeDir, QObject* parent = nullptr);
+    ~IoTropolisRegistrationServer() override;
 
-    bool start(quint16 port);
+    // A connection deferred at admission only has to send HELLO and read
+    // RETRY_AFTER; it is closed after this long instead of the handshake timeout
+    static constexpr int DeferredHelloTimeoutMs = 2000;
+
+    // Connection backend: QTcpServer/QTcpSocket, or plain fds on an
+    // edge-triggered epoll set (Linux only)
+    enum class Transport { Qt, Epoll };
+
+    // "0.0.0.0", "::" or an empty bindAddress listen on every interface
+    bool start(const QString& bindAddress, quint16 port, Transport transport = Transport::Qt);
+
+    // Sample datagrams from registered units; call before start() so
+    // every unit is offered a session in DESCRIBE_ACK
+    bool startUdpIngest(const QString& bindAddress, quint16 port, int threads);
+
+    // Capture traffic of connections accepted from now on; the recorder
+    // must outlive the server
+    void setSessionRecorder(SessionRecorder* recorder) { m_recorder = recorder; }
+
+    // Token buckets, handshake cap and accept backlog
+    void setAdmissionSettings(const AdmissionSettings& settings);
+
+    // Sensor history retained per series (raw samples / windows per resolution)
+    void setSampleHistory(int rawPerSensor, int windowsPerResolution);
+    // How long / how many disconnected units keep their history
+    void setSampleRetention(int retentionSec, int maxRetainedUnits);
+
+    // Rollup stage; connect to windowsClosed() to subscribe to closed windows
+    SensorAggregator* aggregator() { return &m_aggregator; }
+    SampleStore* sampleStore() { return &m_store; }
+
+    // Fully registered units, indexed for lookups from other threads
+    UnitRegistry* registry() { return &m_registry; }
+
+    // Persistent unit type definitions
+    UnitTypeCatalog* typeCatalog() { return &m_typeCatalog; }
+
+    // Connection count, their total footprint and the topN heaviest
+    void collectConnectionMemory(int topN, MemoryReport* report) const;
 
 signals:
     // Unit passed HELLO; protocol compatibility confirmed
@@ -34,17 +88,47 @@ signals:
 
 private slots:
     void onNewConnection();
-    void onUnitHello(IoTropolisUnitConnection* unit);
-    void onUnitDescribe(IoTropolisUnitConnection* unit);
-    void onUnitProtocolError(IoTropolisUnitConnection* unit, const QString& msg);
-    void onUnitDisconnectedInternal(IoTropolisUnitConnection* unit);
+    void adoptUnit(IoTropolisUnitConnection* unit);
+    void onUdpSamples(const SensorSampleBatch& samples);
+    void onWindowsClosed(const ClosedWindowBatch& windows);
+    void onFlushTimer();
+    void onDeadlineTimer();
+
+private:
+    // UnitConnectionObserver
+    void onUnitHello(IoTropolisUnitConnection* unit) override;
+    void onUnitDescribe(IoTropolisUnitConnection* unit) override;
+    void onUnitProtocolError(IoTropolisUnitConnection* unit, const QString& msg) override;
+    void onUnitSamples(IoTropolisUnitConnection* unit, const SensorSampleBatch& samples) override;
+    void onUnitDisconnected(IoTropolisUnitConnection* unit) override;
+
+    void ingestSamples(const SensorSampleBatch& samples);
+    void finishHandshake(IoTropolisUnitConnection* unit);
+    void updateAcceptState();
+
+    // Handshake deadlines: one sorted list and one timer for all connections
+    void setDeadline(IoTropolisUnitConnection* unit, int timeoutMs);
+    void clearDeadline(IoTropolisUnitConnection* unit);
 
 private:
     QSet<IoTropolisUnitConnection*> m_units;
+    QHash<UnitID, IoTropolisUnitConnection*> m_unitsByID;
+    QSet<IoTropolisUnitConnection*> m_handshaking;
+    AdmissionController m_admission;
+    QMultiMap<qint64, IoTropolisUnitConnection*> m_deadlines;   // soonest first
+    QHash<IoTropolisUnitConnection*, qint64> m_deadlineOf;
+    QElapsedTimer m_clock;
+    QTimer m_deadlineTimer;
     QTcpServer* m_server{nullptr};
-    QString m_unitTypeDir;
-
-    UnitID m_nextUnitID{1};
+    EpollUnitListener* m_epoll{nullptr};
+    UdpIngestListener* m_udp{nullptr};
+    UdpSessionTable m_udpSessions;
+    SessionRecorder* m_recorder{nullptr};
+    UnitRegistry m_registry;
+    UnitTypeCatalog m_typeCatalog;
+    SensorAggregator m_aggregator;
+    SampleStore m_store;
+    QTimer m_flushTimer;
 };
 
 #endif // IOTROPOLISREGISTRATIONSERVER_H
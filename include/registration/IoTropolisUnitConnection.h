@@ -7,12 +7,16 @@
 #include <QList>
 #include <QMap>
 
+#include "registration/HandshakeParser.h"
 #include "registration/IOComponent.h"
+#include "registration/UnitID.h"
+#include "ingest/SensorSample.h"
+#include "transport/UnitTransport.h"
+#include "registration/UnitConnectionObserver.h"
 
-constexpr int MAX_UNKNOWN_COMMANDS = 5;
+class SessionRecorder;
 
-// Type alias for unit ID
-using UnitID = quint32;
+constexpr int MAX_UNKNOWN_COMMANDS = 5;
 
 class IoTropolisUnitConnection : public QObject
 {
@@ -21,11 +25,40 @@ public:
     explicit IoTropolisUnitConnection(QTcpSocket* socket,
                                       QObject* parent = nullptr);
 
+    // Non-Qt transport (e.g. epoll backend); the transport owns itself
+    explicit IoTropolisUnitConnection(UnitTransport* transport,
+                                      QObject* parent = nullptr);
+
+    // --------------------------------------------------------
+    // Transport entry points
+    // --------------------------------------------------------
+    void processLine(const QByteArray& line);
+    void transportClosed();
+
+    // Capture inbound lines and replies from now on (nullptr stops)
+    void setRecorder(SessionRecorder* recorder);
+
+    // Receives every event of this connection; must outlive it
+    void setObserver(UnitConnectionObserver* observer) { m_observer = observer; }
+
+    // --------------------------------------------------------
+    // Admission
+    // --------------------------------------------------------
+    // Answer the next HELLO with "RETRY_AFTER <ms>" and disconnect
+    void rejectWithRetryAfter(int retryAfterMs) { m_retryAfterMs = retryAfterMs; }
+    bool isRejected() const { return m_retryAfterMs > 0; }
+
+    bool handshakeDone() const { return m_describeDone; }
+    void closeConnection(const QString& reason, const QString& clientMsg = QString());
+
     // --------------------------------------------------------
     // Connection info
     // --------------------------------------------------------
     QString ipAddress() const;
 
+    // Approximate heap held for this connection, including buffered I/O
+    qint64 memoryBytes() const;
+
     // --------------------------------------------------------
     // IO Components
     // --------------------------------------------------------
@@ -44,11 +77,24 @@ public:
     UnitID unitID() const       { return m_unitID; }
     void setUnitID(UnitID id)   { m_unitID = id; }
 
-signals:
-    void helloCompleted();
-    void describeCompleted();
-    void protocolError(const QString& msg);
-    void disconnected();
+    // Stable identity sent in HELLO (e.g. serial number); may be empty
+    QString identity() const    { return m_identity; }
+
+    // Secret sent with the identity to prove a previous registration
+    QString identitySecret() const { return m_identitySecret; }
+
+    // Secret for a newly bound identity, sent once in HELLO_ACK. Only
+    // valid while the observer's onUnitHello() runs.
+    void issueIdentitySecret(const QString& secret) { m_issuedSecret = secret; }
+
+    // --------------------------------------------------------
+    // UDP ingest
+    // --------------------------------------------------------
+    // Offered to the unit in DESCRIBE_ACK; set by the server in
+    // onUnitDescribe(), once it has accepted the unit.
+    // Token 0 means no UDP session.
+    void setUdpSession(quint64 token, quint16 port) { m_udpToken = token; m_udpPort = port; }
+    quint64 udpSessionToken() const { return m_udpToken; }
 
 private slots:
     void onReadyRead();
@@ -68,6 +114,7 @@ private:
     // Command Handlers
     void handleHello(const QByteArray& data);
     void handleDescribe(const QByteArray& data);
+    void handleSample(const QByteArray& data);
     void handleUnknownCommand(const QString& command);
 
     // --------------------------------------------------------
@@ -76,27 +123,44 @@ private:
     void failProtocol(const QString& msg,
                       const QString& clientMsg = QString());
     void sendReply(const QString& msg);
+    void closeTransport();
     void resetUnknownCommandCounter();
+    void recordClose();
 
-    bool parseComponents(const QJsonArray& array, 
-                         QList<IOComponent>& list, 
-                         const QString& label);
+    int sensorIndex(const QString& name) const;
 
     // --------------------------------------------------------
     // Data members
     // --------------------------------------------------------
     QTcpSocket* m_socket{nullptr};
+    UnitTransport* m_transport{nullptr};
+    QString m_transportAddress;
 
     bool m_helloDone{false};
     bool m_describeDone{false};
+    bool m_closed{false};
 
+    QString m_identity;
+    QString m_identitySecret;
+    QString m_issuedSecret;
     QString m_unitType;
     QString m_unitSubtype;
 
     QList<IOComponent> m_sensors;
     QList<IOComponent> m_actuators;
 
+    HandshakeParser m_parser;
+
     int m_unknownCommandCount{0};
+    int m_retryAfterMs{0};
+
+    UnitConnectionObserver* m_observer{nullptr};
+
+    SessionRecorder* m_recorder{nullptr};
+    quint32 m_captureSession{0};
+
+    quint64 m_udpToken{0};
+    quint16 m_udpPort{0};
 
     UnitID m_unitID{0}; 
 };
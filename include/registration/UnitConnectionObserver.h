@@ -0,0 +1,31 @@
+#ifndef UNITCONNECTIONOBSERVER_H
+#define UNITCONNECTIONOBSERVER_H
+
+#include <QString>
+
+#include "ingest/SensorSample.h"
+
+class IoTropolisUnitConnection;
+
+// Receives the events of an IoTropolisUnitConnection. Called directly
+// instead of through signals: at tens of thousands of connections, five
+// Qt connections per unit (connection record, slot object, sender and
+// receiver list entries) cost more heap than the handshake state itself.
+class UnitConnectionObserver
+{
+public:
+    virtual ~UnitConnectionObserver() = default;
+
+    virtual void onUnitHello(IoTropolisUnitConnection* unit) = 0;
+    virtual void onUnitDescribe(IoTropolisUnitConnection* unit) = 0;
+    virtual void onUnitProtocolError(IoTropolisUnitConnection* unit, const QString& msg) = 0;
+
+    // Readings of declared sensors, validated against their formats
+    virtual void onUnitSamples(IoTropolisUnitConnection* unit,
+                               const SensorSampleBatch& samples) = 0;
+
+    // The stream is gone; the observer owns the connection from here on
+    virtual void onUnitDisconnected(IoTropolisUnitConnection* unit) = 0;
+};
+
+#endif // UNITCONNECTIONOBSERVER_H
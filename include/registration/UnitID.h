@@ -0,0 +1,9 @@
+#ifndef UNITID_H
+#define UNITID_H
+
+#include <QtGlobal>
+
+// Type alias for unit ID
+using UnitID = quint32;
+
+#endif // UNITID_H
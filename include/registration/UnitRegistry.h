@@ -0,0 +1,158 @@
+#ifndef UNITREGISTRY_H
+#define UNITREGISTRY_H
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <QDataStream>
+#include <QReadWriteLock>
+
+#include <functional>
+#include <vector>
+
+#include "registration/IOComponent.h"
+#include "registration/UnitID.h"
+
+// Plain-data view of a fully registered unit, safe to copy across threads
+struct UnitRecord
+{
+    UnitID unitID{0};
+    quint8 originNode{0};       // node the unit is connected to
+    QString identity;
+    QString ipAddress;
+    QString unitType;
+    QString unitSubtype;
+    QList<IOComponent> sensors;
+    QList<IOComponent> actuators;
+
+    int sensorIndex(const QString& name) const;
+};
+
+// One mutation of the registry, in the order it was applied.
+// 'seq' is assigned by the registry and increases by one per delta.
+struct RegistryDelta
+{
+    enum class Kind : quint8 {
+        UnitRegistered = 1,     // record
+        UnitRemoved    = 2,     // unitID
+        IdentityBound  = 3,     // identity -> unitID, secretHash
+        IdsReserved    = 4,     // unitID = new reservation high-water mark
+        TypeCreated    = 5      // record holds the type definition
+    };
+
+    Kind kind{Kind::UnitRegistered};
+    quint64 seq{0};
+    UnitID unitID{0};
+    QString identity;
+    QByteArray secretHash;
+    UnitRecord record;
+};
+
+// Copy-on-write view of the registry; taking one only bumps refcounts
+struct RegistrySnapshot
+{
+    quint64 seq{0};
+    UnitID reservedUpTo{0};
+    QHash<QString, UnitID> identities;
+    QHash<QString, QByteArray> identitySecrets;
+    QHash<UnitID, UnitRecord> units;
+};
+
+QDataStream& operator<<(QDataStream& out, const IOComponent& c);
+QDataStream& operator>>(QDataStream& in, IOComponent& c);
+QDataStream& operator<<(QDataStream& out, const UnitRecord& r);
+QDataStream& operator>>(QDataStream& in, UnitRecord& r);
+QDataStream& operator<<(QDataStream& out, const RegistryDelta& d);
+QDataStream& operator>>(QDataStream& in, RegistryDelta& d);
+
+// Registered units indexed by type and by sensor name, plus the UnitID
+// allocator and the identity -> UnitID table that survives restarts.
+// Written from the server thread, read concurrently by query workers.
+class UnitRegistry
+{
+public:
+    // UnitIDs are reserved in blocks so only one delta per block
+    // needs to be persisted.
+    static constexpr UnitID IdReserveBlock = 1024;
+
+    // The top bits of a UnitID carry the allocating node, so nodes of a
+    // replicated cluster never hand out the same ID.
+    static constexpr int NodeIdShift = 24;
+    static constexpr UnitID LocalIdMask = (UnitID(1) << NodeIdShift) - 1;
+
+    using DeltaListener = std::function<void(const RegistryDelta&)>;
+
+    void setNodeID(quint8 nodeID);
+    quint8 nodeID() const;
+
+    // Local units; the record's originNode is set to this node
+    void insert(const UnitRecord& record);
+    void remove(UnitID unitID);
+
+    bool find(UnitID unitID, UnitRecord* out) const;
+
+    // Empty filters match everything
+    QVector<UnitRecord> unitsMatching(const QString& unitType,
+                                      const QString& sensorName) const;
+
+    int size() const;
+
+    // Approximate heap held by records, indexes and identities
+    qint64 memoryBytes() const;
+
+    // --------------------------------------------------------
+    // Stable identities
+    // --------------------------------------------------------
+    // 0 once the node's local ID space is used up; IDs are never reused
+    UnitID allocateUnitID();
+    UnitID unitIDForIdentity(const QString& identity) const;   // 0 if unknown
+
+    // Hash of the secret issued with the identity; empty for identities
+    // bound before secrets were issued
+    QByteArray identitySecretHash(const QString& identity) const;
+    void bindIdentity(const QString& identity, UnitID unitID, const QByteArray& secretHash);
+
+    // --------------------------------------------------------
+    // Persistence / replication
+    // --------------------------------------------------------
+    RegistrySnapshot snapshot() const;
+
+    // Rebuild persistent state (identities, allocator) before serving.
+    // Does not notify listeners.
+    void restore(const RegistrySnapshot& snapshot);
+    void replay(const RegistryDelta& delta);
+
+    // Deltas received from a peer. Do not notify listeners.
+    void applyRemote(const RegistryDelta& delta);
+    void replaceOrigin(quint8 originNode, const QVector<UnitRecord>& units);
+
+    // Listeners run on the mutating thread after the lock is released
+    void addDeltaListener(DeltaListener listener);
+
+private:
+    void insertLocked(const UnitRecord& record);
+    bool removeLocked(UnitID unitID);
+    void bindIdentityLocked(const QString& identity, UnitID unitID, const QByteArray& secretHash);
+    void notify(const QVector<RegistryDelta>& deltas);
+    RegistryDelta nextDelta(RegistryDelta::Kind kind);
+
+    mutable QReadWriteLock m_lock;
+
+    QHash<UnitID, UnitRecord> m_units;
+    QHash<QString, QSet<UnitID>> m_byType;
+    QHash<QString, QSet<UnitID>> m_bySensor;
+
+    QHash<QString, UnitID> m_identities;
+    QHash<QString, QByteArray> m_identitySecrets;
+    quint8 m_nodeID{0};
+    UnitID m_nextUnitID{1};
+    UnitID m_reservedUpTo{0};
+    quint64 m_seq{0};
+    qint64 m_memoryBytes{0};
+
+    std::vector<DeltaListener> m_listeners;
+};
+
+#endif // UNITREGISTRY_H
@@ -0,0 +1,55 @@
+#ifndef UNITTYPECATALOG_H
+#define UNITTYPECATALOG_H
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+#include "registration/UnitRegistry.h"
+
+// Persistent unit type definitions, one JSON file per type/subtype in the
+// unit type directory. A type is created by the first unit that describes
+// it; later units of the same type must provide every component it lists.
+//
+// Type definitions are passed around as UnitRecords with only unitType,
+// unitSubtype, sensors and actuators filled in.
+class UnitTypeCatalog
+{
+public:
+    enum class Result { Matched, Created, Error };
+
+    using TypeCreatedListener = std::function<void(const UnitRecord& type)>;
+
+    explicit UnitTypeCatalog(const QString& dir);
+
+    QString directory() const { return m_dir; }
+
+    // Later lookups and new types use 'dir'; existing files are not moved
+    void setDirectory(const QString& dir);
+
+    // Check a described unit against its stored type, creating the type if
+    // it does not exist yet. On Error, *error holds the reason.
+    Result validateOrCreate(const UnitRecord& unit, QString* error);
+
+    // Store a type learned elsewhere (e.g. a peer) unless it already exists.
+    // Does not notify the listener.
+    bool ensureType(const UnitRecord& type);
+
+    // Every stored type
+    QVector<UnitRecord> types() const;
+
+    void setTypeCreatedListener(TypeCreatedListener listener);
+
+    // Types live on disk; only the catalog object itself is resident
+    qint64 memoryBytes() const;
+
+private:
+    QString fileFor(const QString& unitType, const QString& unitSubtype) const;
+    bool writeType(const UnitRecord& type, const QString& filename);
+
+    QString m_dir;
+    TypeCreatedListener m_listener;
+};
+
+#endif // UNITTYPECATALOG_H
@@ -0,0 +1,142 @@
+#ifndef IOTROPOLISREPLICATIONNODE_H
+#define IOTROPOLISREPLICATIONNODE_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QQueue>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+
+#include <memory>
+
+#include "registration/UnitRegistry.h"
+#include "registration/UnitTypeCatalog.h"
+
+// Registry replication between IoTropolis nodes.
+//
+// Every node publishes the deltas of its own units (registered, removed,
+// identity bound) and of the types it created, numbered by a per-process
+// sequence. Peers subscribe by dialing the node and sending HELLO with
+// the last (epoch, seq) they applied; the node replies with the missed
+// deltas if it still retains them, or with a snapshot otherwise, and then
+// streams live deltas. Nodes only publish what they own, so every node
+// lists every other node in its peers.
+//
+// Both ends prove knowledge of the cluster's shared secret before anything
+// else is exchanged: the node sends CHALLENGE with a nonce, the subscriber
+// answers AUTH with its own nonce and an HMAC over both, and the node
+// replies AUTH_ACK with the reverse HMAC. The node ignores HELLO and the
+// subscriber ignores snapshots and deltas until the other side is proven.
+//
+// Frames: [quint32 length][quint8 type][QDataStream payload]
+class IoTropolisReplicationNode : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int MaxRetainedDeltas = 8192;
+    static constexpr int ReconnectDelayMs  = 2000;
+    static constexpr int PurgeDelayMs      = 30000;
+
+    // Unsent bytes a subscriber may have queued before it is dropped; above
+    // the largest frame so a full snapshot plus live deltas still fit
+    static constexpr qint64 MaxSubscriberBacklog = 96 * 1024 * 1024;
+
+    // A subscriber that has not authenticated by then is dropped
+    static constexpr int AuthTimeoutMs = 5000;
+    static constexpr int NonceSize     = 32;
+
+    IoTropolisReplicationNode(UnitRegistry* registry,
+                              UnitTypeCatalog* catalog,
+                              QObject* parent = nullptr);
+    ~IoTropolisReplicationNode() override;
+
+    // Shared by every node of the cluster; start() refuses to run without
+    void setSharedSecret(const QByteArray& secret);
+
+    // peers: "host:port" of every other node. "0.0.0.0", "::" or an
+    // empty bindAddress listen on all interfaces.
+    bool start(const QString& bindAddress, quint16 port, const QStringList& peers);
+
+private slots:
+    void onNewConnection();
+
+private:
+    enum MessageType : quint8 {
+        MsgHello     = 1,
+        MsgSnapshot  = 2,
+        MsgDelta     = 3,
+        MsgChallenge = 4,
+        MsgAuth      = 5,
+        MsgAuthAck   = 6
+    };
+
+    // Inbound link: a subscriber of our stream
+    struct Downstream
+    {
+        QByteArray buffer;
+        QByteArray nonce;
+        bool authenticated{false};
+    };
+
+    // Outbound link: our subscription to one peer's stream
+    struct Upstream
+    {
+        QString host;
+        quint16 port{0};
+        QTcpSocket* socket{nullptr};
+        QTimer* purgeTimer{nullptr};
+        QByteArray buffer;
+        QByteArray nonce;
+        QByteArray peerNonce;
+        bool authenticated{false};
+
+        bool originKnown{false};
+        quint8 originNode{0};
+        quint64 epoch{0};
+        quint64 seq{0};
+        bool resyncing{false};      // snapshot requested, drop deltas until then
+    };
+
+    // Publishing side
+    void publish(RegistryDelta delta);
+    bool handleAuth(QTcpSocket* socket, Downstream& down, const QByteArray& payload);
+    void handleHello(QTcpSocket* socket, const QByteArray& payload);
+    void sendSnapshot(QTcpSocket* socket);
+    void onDownstreamData(QTcpSocket* socket);
+
+    // Subscribing side
+    void connectUpstream(Upstream* up);
+    void sendHello(Upstream* up);
+    void onUpstreamData(Upstream* up);
+    void answerChallenge(Upstream* up, const QByteArray& payload);
+    bool checkAuthAck(Upstream* up, const QByteArray& payload);
+    void applySnapshot(Upstream* up, const QByteArray& payload);
+    void applyDelta(Upstream* up, const QByteArray& payload);
+    void purgeUpstream(Upstream* up);
+
+    static QByteArray frame(quint8 type, const QByteArray& payload);
+    static bool takeFrame(QByteArray& buffer, quint8* type, QByteArray* payload, bool* error);
+    QByteArray authCode(const char* role, const QByteArray& first, const QByteArray& second) const;
+
+    UnitRegistry* m_registry{nullptr};
+    UnitTypeCatalog* m_catalog{nullptr};
+    quint8 m_nodeID{0};
+    QByteArray m_secret;
+
+    quint64 m_epoch{0};
+    quint64 m_seq{0};
+    QQueue<QPair<quint64, QByteArray>> m_log;     // retained delta frames
+
+    QTcpServer* m_server{nullptr};
+    QHash<QTcpSocket*, Downstream> m_downstreams;
+    QSet<QTcpSocket*> m_subscribers;
+    QList<Upstream*> m_upstreams;
+
+    // Registry listeners cannot be removed; they reach us through this
+    std::shared_ptr<IoTropolisReplicationNode*> m_self;
+};
+
+#endif // IOTROPOLISREPLICATIONNODE_H
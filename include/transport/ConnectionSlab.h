@@ -0,0 +1,67 @@
+#ifndef CONNECTIONSLAB_H
+#define CONNECTIONSLAB_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Fixed-size object pool for per-connection state. Objects are carved from
+// blocks of BlockSize slots and recycled through a free list, so a large
+// fleet of connections costs one allocation per block instead of one per
+// connection and stays densely packed.
+template <typename T, int BlockSize = 1024>
+class ConnectionSlab
+{
+public:
+    ConnectionSlab() = default;
+    ConnectionSlab(const ConnectionSlab&) = delete;
+    ConnectionSlab& operator=(const ConnectionSlab&) = delete;
+
+    // Live objects must be destroyed by the owner first
+    ~ConnectionSlab() = default;
+
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        if (m_free.empty())
+            grow();
+
+        Slot* slot = m_free.back();
+        m_free.pop_back();
+        ++m_live;
+        return new (slot->bytes) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* obj)
+    {
+        obj->~T();
+        m_free.push_back(reinterpret_cast<Slot*>(obj));
+        --m_live;
+    }
+
+    std::size_t live() const { return m_live; }
+    std::size_t capacity() const { return m_blocks.size() * BlockSize; }
+
+private:
+    struct alignas(T) Slot
+    {
+        unsigned char bytes[sizeof(T)];
+    };
+
+    void grow()
+    {
+        m_blocks.emplace_back(new Slot[BlockSize]);
+        Slot* block = m_blocks.back().get();
+        m_free.reserve(m_free.size() + BlockSize);
+        for (int i = BlockSize - 1; i >= 0; --i)
+            m_free.push_back(&block[i]);
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> m_blocks;
+    std::vector<Slot*> m_free;
+    std::size_t m_live{0};
+};
+
+#endif // CONNECTIONSLAB_H
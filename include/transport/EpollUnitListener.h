@@ -0,0 +1,102 @@
+#ifndef EPOLLUNITLISTENER_H
+#define EPOLLUNITLISTENER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QVector>
+
+#include "transport/ConnectionSlab.h"
+#include "transport/UnitTransport.h"
+
+class IoTropolisUnitConnection;
+
+// Linux edge-triggered epoll backend for unit connections.
+//
+// Connections are plain non-blocking fds with their state in a slab; the
+// whole epoll set is watched by a single QSocketNotifier, so all protocol
+// handling still runs on the server thread. Replies queued while a batch
+// of events is processed are flushed once per connection with writev().
+// Reads go through one shared scratch buffer, so idle connections hold
+// no read or write buffer.
+class EpollUnitListener : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int MaxEventsPerWait = 256;
+    static constexpr int MaxWaitRounds    = 4;
+    static constexpr int ReadChunk        = 64 * 1024;
+    static constexpr int MaxLineLength    = 1024 * 1024;
+    static constexpr int MaxIovecs        = 64;
+
+    explicit EpollUnitListener(QObject* parent = nullptr);
+    ~EpollUnitListener() override;
+
+    // "0.0.0.0", "::" or empty listen dual-stack on every interface
+    bool listen(const QString& bindAddress, quint16 port, int backlog);
+
+    // Kernel accept queue length; applies to a listening socket at once
+    void setBacklog(int backlog);
+
+    // While paused, new connections wait in the kernel backlog
+    void setAcceptPaused(bool paused);
+
+    int connectionCount() const { return m_connections.size(); }
+
+signals:
+    // A new unit connection; the receiver takes ownership of the object
+    void newUnit(IoTropolisUnitConnection* unit);
+
+private slots:
+    void onEpollReadable();
+
+private:
+    // Per-connection state, slab allocated
+    class Connection : public UnitTransport
+    {
+    public:
+        Connection(EpollUnitListener* owner, int fd) : owner(owner), fd(fd) {}
+
+        void write(const QByteArray& data) override;
+        void close() override;
+        bool isOpen() const override { return !closing && !dead; }
+        QString peerAddress() const override;
+        qint64 memoryBytes() const override;
+
+        EpollUnitListener* owner;
+        int fd;
+        int index{-1};                      // position in m_connections
+        IoTropolisUnitConnection* unit{nullptr};
+
+        QByteArray in;                      // partial line only
+        QVector<QByteArray> out;
+        int outOffset{0};                   // bytes of out.first() already sent
+
+        bool dirty{false};
+        bool closing{false};
+        bool dead{false};
+    };
+
+    void acceptPending();
+    void flushPending();
+    void handleReadable(Connection* c);
+    void consume(Connection* c, const char* data, int length);
+    void flush(Connection* c);
+    void markDirty(Connection* c);
+    void scheduleTeardown(Connection* c);
+    void teardown(Connection* c);
+
+    int m_epollFd{-1};
+    int m_listenFd{-1};
+    bool m_acceptPaused{false};
+    bool m_inBatch{false};
+    bool m_flushScheduled{false};
+    QSocketNotifier* m_notifier{nullptr};
+
+    ConnectionSlab<Connection> m_slab;
+    QVector<Connection*> m_connections;
+    QVector<Connection*> m_dirty;
+    QVector<Connection*> m_closing;
+    QByteArray m_readBuffer;
+};
+
+#endif // EPOLLUNITLISTENER_H
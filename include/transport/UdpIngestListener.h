@@ -0,0 +1,75 @@
+#ifndef UDPINGESTLISTENER_H
+#define UDPINGESTLISTENER_H
+
+#include <QObject>
+#include <QVector>
+
+#include <atomic>
+
+#include "ingest/SensorSample.h"
+#include "ingest/UdpSessionTable.h"
+
+class QThread;
+
+// UDP sample ingest for units that finished DESCRIBE (Linux only).
+//
+// One SO_REUSEPORT socket per receive thread, so the kernel spreads
+// datagrams across threads; each thread drains its socket with
+// recvmmsg(). Valid samples leave through samplesReceived(), emitted on
+// the receive thread and delivered queued to receivers on other threads.
+//
+// Datagram layout, little-endian:
+//   u16 magic 'IT' | u8 version | u8 count | u32 unitID | u64 session token
+//   | i64 base timestamp ms (0 = time of arrival)
+//   followed by count entries of
+//   u16 sensor index | u16 reserved | i32 offset ms | f64 value
+// A datagram with an unknown session or any invalid entry is dropped whole.
+// Samples still queued when their unit disconnects are discarded by the
+// server.
+class UdpIngestListener : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr quint16 Magic        = 0x5449;     // "IT"
+    static constexpr quint8  Version      = 1;
+    static constexpr int     HeaderSize   = 24;
+    static constexpr int     EntrySize    = 16;
+    static constexpr int     MaxDatagram  = 1472;       // one Ethernet frame
+    static constexpr int     MaxEntries   = (MaxDatagram - HeaderSize) / EntrySize;
+    static constexpr int     RecvBatch    = 64;
+    static constexpr int     PollTimeoutMs = 250;
+
+    explicit UdpIngestListener(const UdpSessionTable* sessions,
+                               QObject* parent = nullptr);
+    ~UdpIngestListener() override;
+
+    // "0.0.0.0", "::" or empty listen dual-stack on every interface
+    bool start(const QString& bindAddress, quint16 port, int threads);
+    void stop();
+
+    quint16 port() const { return m_port; }
+
+    quint64 datagramsReceived() const { return m_received.load(std::memory_order_relaxed); }
+    quint64 datagramsDropped() const  { return m_dropped.load(std::memory_order_relaxed); }
+
+signals:
+    void samplesReceived(const SensorSampleBatch& samples);
+
+private:
+    int openSocket(const QString& bindAddress, quint16 port);
+    void receiveLoop(int fd);
+    bool decode(const uchar* data, int length, qint64 nowMs,
+                SensorSampleBatch* out) const;
+
+    const UdpSessionTable* m_sessions;
+    quint16 m_port{0};
+
+    QVector<int> m_fds;
+    QVector<QThread*> m_threads;
+    std::atomic<bool> m_running{false};
+
+    std::atomic<quint64> m_received{0};
+    std::atomic<quint64> m_dropped{0};
+};
+
+#endif // UDPINGESTLISTENER_H
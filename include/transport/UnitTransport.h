@@ -0,0 +1,28 @@
+#ifndef UNITTRANSPORT_H
+#define UNITTRANSPORT_H
+
+#include <QByteArray>
+#include <QString>
+
+// Byte stream underneath an IoTropolisUnitConnection when it is not backed
+// by a QTcpSocket. The transport feeds complete lines to
+// IoTropolisUnitConnection::processLine() and reports the end of the
+// stream with transportClosed().
+class UnitTransport
+{
+public:
+    virtual ~UnitTransport() = default;
+
+    virtual void write(const QByteArray& data) = 0;
+
+    // Flush pending output, then close
+    virtual void close() = 0;
+
+    virtual bool isOpen() const = 0;
+    virtual QString peerAddress() const = 0;
+
+    // Heap held by the transport: its state and any buffered input/output
+    virtual qint64 memoryBytes() const = 0;
+};
+
+#endif // UNITTRANSPORT_H
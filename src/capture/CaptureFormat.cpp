@@ -0,0 +1,118 @@
+#include "capture/CaptureFormat.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+namespace CaptureFormat {
+
+namespace {
+
+const char Magic[4] = {'I', 'O', 'T', 'C'};
+
+template <typename T>
+void appendLE(QByteArray* out, T value)
+{
+    uchar raw[sizeof(T)];
+    qToLittleEndian(value, raw);
+    out->append(reinterpret_cast<const char*>(raw), int(sizeof(T)));
+}
+
+bool replaceValue(QJsonObject* obj, const char* key, const char* placeholder)
+{
+    if (!obj->contains(QLatin1String(key)))
+        return false;
+    obj->insert(QLatin1String(key), QLatin1String(placeholder));
+    return true;
+}
+
+} // namespace
+
+QByteArray redactSecrets(const QByteArray& line)
+{
+    const int space = line.indexOf(' ');
+    if (space < 0)
+        return line;
+
+    const QByteArray command = line.left(space);
+    if (command != "HELLO" && command != "HELLO_ACK" && command != "DESCRIBE_ACK")
+        return line;
+
+    // Re-serialized rather than patched in place: escapes and duplicate
+    // keys cannot hide a credential from the redaction
+    const QJsonDocument doc = QJsonDocument::fromJson(line.mid(space + 1));
+    if (!doc.isObject())
+        return command + ' ' + RedactedPayload;
+
+    QJsonObject obj = doc.object();
+    bool changed = replaceValue(&obj, "secret", SecretPlaceholder);
+    changed |= replaceValue(&obj, "identity_secret", SecretPlaceholder);
+    changed |= replaceValue(&obj, "session_token", TokenPlaceholder);
+    if (!changed)
+        return line;
+
+    return command + ' ' + QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+void appendFileHeader(QByteArray* out, qint64 startEpochMs)
+{
+    out->append(Magic, 4);
+    appendLE<quint16>(out, Version);
+    appendLE<quint16>(out, 0);
+    appendLE<qint64>(out, startEpochMs);
+}
+
+void appendRecord(QByteArray* out, RecordKind kind, quint32 session,
+                  quint64 timeUs, const char* data, int length)
+{
+    out->append(char(kind));
+    appendLE<quint32>(out, session);
+    appendLE<quint64>(out, timeUs);
+    appendLE<quint32>(out, quint32(length));
+    out->append(data, length);
+}
+
+bool Reader::open(const QString& path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    const QByteArray header = m_file.read(FileHeaderSize);
+    const auto* p = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() != FileHeaderSize || !header.startsWith(QByteArray(Magic, 4))) {
+        m_error = "Not a capture file";
+        return false;
+    }
+    if (qFromLittleEndian<quint16>(p + 4) != Version) {
+        m_error = "Unsupported capture version";
+        return false;
+    }
+
+    m_startEpochMs = qFromLittleEndian<qint64>(p + 8);
+    return true;
+}
+
+bool Reader::next(Record* record)
+{
+    uchar header[RecordHeaderSize];
+    if (m_file.read(reinterpret_cast<char*>(header), RecordHeaderSize) != RecordHeaderSize)
+        return false;
+
+    const quint32 length = qFromLittleEndian<quint32>(header + 13);
+    if (length > MaxPayload) {
+        m_error = "Corrupt record length";
+        return false;
+    }
+
+    record->kind    = RecordKind(header[0]);
+    record->session = qFromLittleEndian<quint32>(header + 1);
+    record->timeUs  = qFromLittleEndian<quint64>(header + 5);
+    record->payload = m_file.read(length);
+
+    return record->payload.size() == int(length);
+}
+
+} // namespace CaptureFormat
@@ -0,0 +1,138 @@
+#include "capture/SessionRecorder.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+SessionRecorder::~SessionRecorder()
+{
+    stop();
+}
+
+bool SessionRecorder::start(const QString& path)
+{
+    if (m_thread)
+        return true;
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // Truncate now so a bad path is reported at startup
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "[IoTropolisCapture] Cannot open capture file" << path
+                   << ":" << file.errorString();
+        return false;
+    }
+
+    QByteArray header;
+    CaptureFormat::appendFileHeader(&header, QDateTime::currentMSecsSinceEpoch());
+    file.write(header);
+    file.close();
+
+    m_path = path;
+    m_clock.start();
+    m_running = true;
+    m_thread = QThread::create([this]() { writerLoop(); });
+    m_thread->start();
+
+    qDebug() << "[IoTropolisCapture] Recording unit sessions to" << path;
+    return true;
+}
+
+void SessionRecorder::stop()
+{
+    if (!m_thread)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        m_wake.wakeAll();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+
+    if (m_dropped)
+        qWarning() << "[IoTropolisCapture]" << m_dropped << "records dropped";
+}
+
+quint32 SessionRecorder::openSession(const QString& peerAddress)
+{
+    const QByteArray peer = peerAddress.toUtf8();
+
+    QMutexLocker locker(&m_mutex);
+    const quint32 session = m_nextSession++;
+    locker.unlock();
+
+    record(CaptureFormat::RecordKind::Open, session, peer);
+    return session;
+}
+
+void SessionRecorder::record(CaptureFormat::RecordKind kind, quint32 session,
+                             const char* data, int length)
+{
+    const quint64 timeUs = quint64(m_clock.nsecsElapsed() / 1000);
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_running)
+        return;
+
+    if (m_pending.size() + CaptureFormat::RecordHeaderSize + length > MaxPendingBytes) {
+        ++m_dropped;
+        return;
+    }
+
+    CaptureFormat::appendRecord(&m_pending, kind, session, timeUs, data, length);
+}
+
+quint64 SessionRecorder::droppedRecords() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+qint64 SessionRecorder::memoryBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_pending.capacity());
+}
+
+void SessionRecorder::writerLoop()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "[IoTropolisCapture] Cannot append to" << m_path;
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        m_pending.clear();
+        return;
+    }
+
+    QByteArray batch;
+
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        // Records are small; wake on a timer rather than per record
+        if (m_running)
+            m_wake.wait(&m_mutex, ulong(FlushIntervalMs));
+
+        const bool running = m_running;
+        batch.swap(m_pending);
+        locker.unlock();
+
+        if (!batch.isEmpty()) {
+            file.write(batch);
+            file.flush();
+            batch.truncate(0);      // keep capacity for the next swap
+        }
+
+        if (!running)
+            return;
+
+        locker.relock();
+    }
+}
@@ -20,6 +20,32 @@ void IoTropolisConfig::loadDefaults()
     m_bindAddress = "0.0.0.0";
     m_unitTypeDir = "./UnitType";
     m_guiEnabled = true;
+    m_transport = "qt";
+    m_admission = AdmissionSettings();
+    m_rawSamplesPerSensor = 4096;
+    m_windowsPerResolution = 1440;
+    m_retentionSec = 3600;
+    m_maxRetainedUnits = 1024;
+    m_queryEnabled = true;
+    m_querySocket = "iotropolis-query";
+    m_queryWorkers = 2;
+    m_persistenceEnabled = true;
+    m_stateDir = "./state";
+    m_snapshotIntervalSec = 60;
+    m_replicationEnabled = false;
+    m_nodeID = 0;
+    m_replicationPort = 12400;
+    m_replicationPeers.clear();
+    m_replicationBindAddress.clear();
+    m_replicationSecret.clear();
+    m_udpEnabled = false;
+    m_udpPort = 12346;
+    m_udpThreads = 2;
+    m_captureEnabled = false;
+    m_captureFile = "./capture/iotropolis.cap";
+    m_loggingRules.clear();
+    m_metricsIntervalSec = 10;
+    m_metricsLog = false;
 }
 
 void IoTropolisConfig::loadFromFile(const QString& path)
@@ -30,12 +56,167 @@ void IoTropolisConfig::loadFromFile(const QString& path)
     m_bindAddress  = settings.value("server/bind_address", m_bindAddress).toString();
     m_unitTypeDir  = settings.value("paths/unit_type_dir", m_unitTypeDir).toString();
     m_guiEnabled   = settings.value("gui/enable", m_guiEnabled).toBool();
+    m_transport    = settings.value("server/transport", m_transport).toString().toLower();
+
+    m_admission.perIpRate          = settings.value("admission/per_ip_rate", m_admission.perIpRate).toDouble();
+    m_admission.perIpBurst         = settings.value("admission/per_ip_burst", m_admission.perIpBurst).toDouble();
+    m_admission.globalRate         = settings.value("admission/global_rate", m_admission.globalRate).toDouble();
+    m_admission.globalBurst        = settings.value("admission/global_burst", m_admission.globalBurst).toDouble();
+    m_admission.maxInHandshake     = settings.value("admission/max_in_handshake", m_admission.maxInHandshake).toInt();
+    m_admission.acceptBacklog      = settings.value("admission/accept_backlog", m_admission.acceptBacklog).toInt();
+    m_admission.handshakeTimeoutMs = settings.value("admission/handshake_timeout_ms", m_admission.handshakeTimeoutMs).toInt();
+    m_rawSamplesPerSensor  = settings.value("storage/raw_samples_per_sensor", m_rawSamplesPerSensor).toInt();
+    m_windowsPerResolution = settings.value("storage/windows_per_resolution", m_windowsPerResolution).toInt();
+    m_retentionSec         = settings.value("storage/retention", m_retentionSec).toInt();
+    m_maxRetainedUnits     = settings.value("storage/max_retained_units", m_maxRetainedUnits).toInt();
+    m_queryEnabled = settings.value("query/enable", m_queryEnabled).toBool();
+    m_querySocket  = settings.value("query/socket", m_querySocket).toString();
+    m_queryWorkers = settings.value("query/workers", m_queryWorkers).toInt();
+    m_persistenceEnabled  = settings.value("persistence/enable", m_persistenceEnabled).toBool();
+    m_stateDir            = settings.value("paths/state_dir", m_stateDir).toString();
+    m_snapshotIntervalSec = settings.value("persistence/snapshot_interval", m_snapshotIntervalSec).toInt();
+    m_replicationEnabled = settings.value("replication/enable", m_replicationEnabled).toBool();
+    m_nodeID             = quint8(settings.value("replication/node_id", m_nodeID).toUInt());
+    m_replicationPort    = settings.value("replication/port", m_replicationPort).toUInt();
+    m_replicationPeers   = settings.value("replication/peers", m_replicationPeers).toStringList();
+    m_replicationBindAddress = settings.value("replication/bind_address", m_replicationBindAddress).toString();
+    m_replicationSecret      = settings.value("replication/secret").toString().toUtf8();
+    m_udpEnabled = settings.value("udp/enable", m_udpEnabled).toBool();
+    m_udpPort    = settings.value("udp/port", m_udpPort).toUInt();
+    m_udpThreads = settings.value("udp/threads", m_udpThreads).toInt();
+    m_captureEnabled = settings.value("capture/enable", m_captureEnabled).toBool();
+    m_captureFile    = settings.value("capture/file", m_captureFile).toString();
+    // A comma-separated list in the INI, e.g. rules = *.debug=false, default.info=true
+    m_loggingRules = settings.value("logging/rules", m_loggingRules).toStringList().join('\n');
+    m_metricsIntervalSec = settings.value("metrics/interval", m_metricsIntervalSec).toInt();
+    m_metricsLog         = settings.value("metrics/log", m_metricsLog).toBool();
 }
 
 quint16 IoTropolisConfig::tcpPort() const { return m_tcpPort; }
 QString IoTropolisConfig::bindAddress() const { return m_bindAddress; }
 QString IoTropolisConfig::unitTypeDir() const { return m_unitTypeDir; }
 bool IoTropolisConfig::guiEnabled() const { return m_guiEnabled; }
+QString IoTropolisConfig::transport() const { return m_transport; }
+AdmissionSettings IoTropolisConfig::admission() const { return m_admission; }
+int IoTropolisConfig::rawSamplesPerSensor() const { return m_rawSamplesPerSensor; }
+int IoTropolisConfig::windowsPerResolution() const { return m_windowsPerResolution; }
+int IoTropolisConfig::retentionSec() const { return m_retentionSec; }
+int IoTropolisConfig::maxRetainedUnits() const { return m_maxRetainedUnits; }
+bool IoTropolisConfig::queryEnabled() const { return m_queryEnabled; }
+QString IoTropolisConfig::querySocket() const { return m_querySocket; }
+int IoTropolisConfig::queryWorkers() const { return m_queryWorkers; }
+bool IoTropolisConfig::persistenceEnabled() const { return m_persistenceEnabled; }
+QString IoTropolisConfig::stateDir() const { return m_stateDir; }
+int IoTropolisConfig::snapshotIntervalSec() const { return m_snapshotIntervalSec; }
+bool IoTropolisConfig::replicationEnabled() const { return m_replicationEnabled; }
+quint8 IoTropolisConfig::nodeID() const { return m_nodeID; }
+quint16 IoTropolisConfig::replicationPort() const { return m_replicationPort; }
+QStringList IoTropolisConfig::replicationPeers() const { return m_replicationPeers; }
+QString IoTropolisConfig::replicationBindAddress() const
+{
+    return m_replicationBindAddress.isEmpty() ? m_bindAddress : m_replicationBindAddress;
+}
+QByteArray IoTropolisConfig::replicationSecret() const { return m_replicationSecret; }
+bool IoTropolisConfig::udpEnabled() const { return m_udpEnabled; }
+quint16 IoTropolisConfig::udpPort() const { return m_udpPort; }
+int IoTropolisConfig::udpThreads() const { return m_udpThreads; }
+bool IoTropolisConfig::captureEnabled() const { return m_captureEnabled; }
+QString IoTropolisConfig::captureFile() const { return m_captureFile; }
+QString IoTropolisConfig::loggingRules() const { return m_loggingRules; }
+int IoTropolisConfig::metricsIntervalSec() const { return m_metricsIntervalSec; }
+bool IoTropolisConfig::metricsLog() const { return m_metricsLog; }
+
+bool IoTropolisConfig::validate(QString* error) const
+{
+    auto fail = [error](const QString& msg) {
+        if (error)
+            *error = msg;
+        return false;
+    };
+
+    if (m_tcpPort == 0)
+        return fail("server/tcp_port must be set");
+    if (m_transport != "qt" && m_transport != "epoll")
+        return fail("server/transport must be qt or epoll");
+    if (m_unitTypeDir.isEmpty())
+        return fail("paths/unit_type_dir must be set");
+    if (m_admission.perIpRate <= 0 || m_admission.globalRate <= 0)
+        return fail("admission rates must be positive");
+    if (m_admission.perIpBurst < 1 || m_admission.globalBurst < 1)
+        return fail("admission bursts must be at least 1");
+    if (m_admission.maxInHandshake < 1 || m_admission.acceptBacklog < 1 ||
+        m_admission.handshakeTimeoutMs < 1)
+        return fail("admission limits must be positive");
+    if (m_rawSamplesPerSensor < 1 || m_windowsPerResolution < 1)
+        return fail("storage capacities must be positive");
+    if (m_retentionSec < 0 || m_maxRetainedUnits < 0)
+        return fail("storage retention must not be negative");
+    if (m_queryWorkers < 1)
+        return fail("query/workers must be at least 1");
+    if (m_snapshotIntervalSec < 1)
+        return fail("persistence/snapshot_interval must be at least 1");
+    if (m_metricsIntervalSec < 0)
+        return fail("metrics/interval must not be negative");
+    if (m_replicationEnabled && m_replicationSecret.isEmpty())
+        return fail("replication/secret must be set when replication is enabled");
+    if (m_udpEnabled && (m_udpPort == 0 || m_udpThreads < 1))
+        return fail("udp/port and udp/threads must be set");
+
+    return true;
+}
+
+QStringList IoTropolisConfig::restartRequiredChanges(const IoTropolisConfig& previous) const
+{
+    QStringList changed;
+    if (m_tcpPort != previous.m_tcpPort)                   changed << "server/tcp_port";
+    if (m_bindAddress != previous.m_bindAddress)           changed << "server/bind_address";
+    if (m_transport != previous.m_transport)               changed << "server/transport";
+    if (m_guiEnabled != previous.m_guiEnabled)             changed << "gui/enable";
+    if (m_queryEnabled != previous.m_queryEnabled)         changed << "query/enable";
+    if (m_querySocket != previous.m_querySocket)           changed << "query/socket";
+    if (m_persistenceEnabled != previous.m_persistenceEnabled) changed << "persistence/enable";
+    if (m_stateDir != previous.m_stateDir)                 changed << "paths/state_dir";
+    if (m_snapshotIntervalSec != previous.m_snapshotIntervalSec) changed << "persistence/snapshot_interval";
+    if (m_replicationEnabled != previous.m_replicationEnabled) changed << "replication/enable";
+    if (m_nodeID != previous.m_nodeID)                     changed << "replication/node_id";
+    if (m_replicationPort != previous.m_replicationPort)   changed << "replication/port";
+    if (m_replicationPeers != previous.m_replicationPeers) changed << "replication/peers";
+    if (m_replicationBindAddress != previous.m_replicationBindAddress) changed << "replication/bind_address";
+    if (m_replicationSecret != previous.m_replicationSecret) changed << "replication/secret";
+    if (m_udpEnabled != previous.m_udpEnabled)             changed << "udp/enable";
+    if (m_udpPort != previous.m_udpPort)                   changed << "udp/port";
+    if (m_udpThreads != previous.m_udpThreads)             changed << "udp/threads";
+    if (m_captureEnabled != previous.m_captureEnabled)     changed << "capture/enable";
+    if (m_captureFile != previous.m_captureFile)           changed << "capture/file";
+    return changed;
+}
+
+IoTropolisConfig IoTropolisConfig::withRestartSettingsOf(const IoTropolisConfig& running) const
+{
+    // Same fields as restartRequiredChanges()
+    IoTropolisConfig applied(*this);
+    applied.m_tcpPort                = running.m_tcpPort;
+    applied.m_bindAddress            = running.m_bindAddress;
+    applied.m_transport              = running.m_transport;
+    applied.m_guiEnabled             = running.m_guiEnabled;
+    applied.m_queryEnabled           = running.m_queryEnabled;
+    applied.m_querySocket            = running.m_querySocket;
+    applied.m_persistenceEnabled     = running.m_persistenceEnabled;
+    applied.m_stateDir               = running.m_stateDir;
+    applied.m_snapshotIntervalSec    = running.m_snapshotIntervalSec;
+    applied.m_replicationEnabled     = running.m_replicationEnabled;
+    applied.m_nodeID                 = running.m_nodeID;
+    applied.m_replicationPort        = running.m_replicationPort;
+    applied.m_replicationPeers       = running.m_replicationPeers;
+    applied.m_replicationBindAddress = running.m_replicationBindAddress;
+    applied.m_replicationSecret      = running.m_replicationSecret;
+    applied.m_udpEnabled             = running.m_udpEnabled;
+    applied.m_udpPort                = running.m_udpPort;
+    applied.m_udpThreads             = running.m_udpThreads;
+    applied.m_captureEnabled         = running.m_captureEnabled;
+    applied.m_captureFile            = running.m_captureFile;
+    return applied;
+}
 
 QString IoTropolisConfig::defaultConfigPath()
 {
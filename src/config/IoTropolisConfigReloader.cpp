@@ -0,0 +1,130 @@
+#include "config/IoTropolisConfigReloader.h"
+
+#include <QFile>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// [0] read by the notifier, [1] written by the signal handler
+int g_sighupPipe[2] = {-1, -1};
+
+void onSighup(int)
+{
+    // A full pipe already holds a pending reload; EAGAIN is fine
+    const int savedErrno = errno;
+    const char c = 1;
+    const ssize_t rc = ::write(g_sighupPipe[1], &c, 1);
+    Q_UNUSED(rc);
+    errno = savedErrno;
+}
+
+} // namespace
+#endif
+
+IoTropolisConfigReloader::IoTropolisConfigReloader(const QString& path,
+                                                   IoTropolisConfigPtr initial,
+                                                   QObject* parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_current(std::move(initial))
+{
+}
+
+IoTropolisConfigReloader::~IoTropolisConfigReloader()
+{
+#ifdef Q_OS_UNIX
+    if (m_notifier) {
+        ::signal(SIGHUP, SIG_DFL);
+        ::close(g_sighupPipe[0]);
+        ::close(g_sighupPipe[1]);
+        g_sighupPipe[0] = g_sighupPipe[1] = -1;
+    }
+#endif
+}
+
+IoTropolisConfigPtr IoTropolisConfigReloader::current() const
+{
+    return std::atomic_load(&m_current);
+}
+
+bool IoTropolisConfigReloader::reload(QString* error)
+{
+    auto fail = [error](const QString& msg) {
+        qWarning() << "[IoTropolisConfig] Reload rejected:" << msg;
+        if (error)
+            *error = msg;
+        return false;
+    };
+
+    // A missing file would silently fall back to defaults
+    if (!QFile::exists(m_path))
+        return fail("Config file not found: " + m_path);
+
+    const IoTropolisConfig loaded(m_path);
+
+    QString reason;
+    if (!loaded.validate(&reason))
+        return fail(reason);
+
+    // Restart-only settings stay as the process runs with them; previous
+    // already carries the running values
+    const IoTropolisConfigPtr previous = current();
+    m_pendingRestart = loaded.restartRequiredChanges(*previous);
+    if (!m_pendingRestart.isEmpty())
+        qWarning() << "[IoTropolisConfig] Changed settings take effect after a restart:"
+                   << m_pendingRestart;
+
+    auto next = std::make_shared<const IoTropolisConfig>(loaded.withRestartSettingsOf(*previous));
+    std::atomic_store(&m_current, IoTropolisConfigPtr(next));
+
+    qDebug() << "[IoTropolisConfig] Reloaded" << m_path;
+    emit configChanged(next, previous);
+    return true;
+}
+
+bool IoTropolisConfigReloader::watchSighup()
+{
+#ifdef Q_OS_UNIX
+    if (m_notifier)
+        return true;
+
+    // Non-blocking on both ends: a burst of signals must never block the
+    // handler, and the notifier drains whatever has accumulated
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, g_sighupPipe) != 0) {
+        qWarning() << "[IoTropolisConfig] Cannot create SIGHUP pipe";
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(g_sighupPipe[0], QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated,
+            this, &IoTropolisConfigReloader::onSignalPipe);
+
+    struct sigaction sa{};
+    sa.sa_handler = onSighup;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &sa, nullptr);
+    return true;
+#else
+    qWarning() << "[IoTropolisConfig] SIGHUP reload is not available on this platform";
+    return false;
+#endif
+}
+
+void IoTropolisConfigReloader::onSignalPipe()
+{
+#ifdef Q_OS_UNIX
+    // Any number of pending signals collapses into one reload
+    char buf[16];
+    while (::read(g_sighupPipe[0], buf, sizeof(buf)) > 0) {}
+
+    qDebug() << "[IoTropolisConfig] SIGHUP received";
+    reload();
+#endif
+}
@@ -7,6 +7,7 @@
 #include <QAction>
 #include <QMessageBox>
 #include <QApplication>
+#include <QStatusBar>
 
 IoTropolisGui::IoTropolisGui(QWidget *parent)
     : QMainWindow(parent)
@@ -41,6 +42,12 @@ IoTropolisGui::IoTropolisGui(QWidget *parent)
     // ===============================
     createMenus();
 
+    // ===============================
+    // Memory summary (updated by MemoryMonitor)
+    // ===============================
+    memoryLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(memoryLabel);
+
     setWindowTitle("IoTropolis");
     resize(1000, 500);
 }
@@ -81,13 +88,32 @@ void IoTropolisGui::addUnit(IoTropolisUnitConnection* unit)
     // Actuators
     unitTable->setItem(row, 5,
         new QTableWidgetItem(unit->actuatorNames().join(", ")));
+
+    m_itemBytes += rowBytes(row);
 }
 
 void IoTropolisGui::removeUnit(IoTropolisUnitConnection* unit)
 {
     int row = findRowByUnitID(unit->unitID());
-    if (row >= 0)
+    if (row >= 0) {
+        m_itemBytes -= rowBytes(row);
         unitTable->removeRow(row);
+    }
+}
+
+qint64 IoTropolisGui::rowBytes(int row) const
+{
+    // Item object, its role/value list and the text it displays
+    constexpr qint64 ItemDataBytes = 64;
+
+    qint64 bytes = 0;
+    for (int col = 0; col < unitTable->columnCount(); ++col) {
+        const QTableWidgetItem* item = unitTable->item(row, col);
+        if (item)
+            bytes += qint64(sizeof(QTableWidgetItem)) + ItemDataBytes +
+                     MemoryStats::bytes(item->text());
+    }
+    return bytes;
 }
 
 int IoTropolisGui::findRowByUnitID(UnitID id) const
@@ -124,6 +150,55 @@ void IoTropolisGui::createMenus()
             this, &IoTropolisGui::showAboutDialog);
 
     aboutMenu->addAction(aboutAction);
+
+    // ---- View menu ----
+    QMenu* viewMenu = menuBar()->addMenu("&View");
+
+    QAction* memoryAction = new QAction("&Memory Usage...", this);
+    connect(memoryAction, &QAction::triggered,
+            this, &IoTropolisGui::showMemoryDialog);
+
+    viewMenu->addAction(memoryAction);
+}
+
+// ===============================
+// Memory accounting
+// ===============================
+
+void IoTropolisGui::showMemoryReport(const MemoryReport& report)
+{
+    m_lastReport = report;
+    memoryLabel->setText(QString("Memory: %1 MiB in %2 connections")
+        .arg(double(report.totalBytes()) / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(report.connectionCount));
+}
+
+void IoTropolisGui::showMemoryDialog()
+{
+    emit memoryReportRequested();
+
+    if (m_lastReport.collectedAtMs == 0) {
+        QMessageBox::information(this, "Memory Usage", "No memory report collected yet.");
+        return;
+    }
+
+    QString text = "<b>Subsystems</b><table>";
+    text += QString("<tr><td>connections (%1)</td><td align=right>%2</td></tr>")
+                .arg(m_lastReport.connectionCount)
+                .arg(m_lastReport.connectionBytes);
+    for (const auto& s : m_lastReport.subsystems)
+        text += QString("<tr><td>%1</td><td align=right>%2</td></tr>")
+                    .arg(QString::fromUtf8(s.name))
+                    .arg(s.bytes);
+    text += "</table><br><b>Heaviest connections</b><table>";
+    for (const auto& c : m_lastReport.topConnections)
+        text += QString("<tr><td>%1</td><td>%2</td><td align=right>%3</td></tr>")
+                    .arg(c.unitID)
+                    .arg(c.ipAddress.toHtmlEscaped())
+                    .arg(c.bytes);
+    text += "</table><br>Bytes, approximate.";
+
+    QMessageBox::information(this, "Memory Usage", text);
 }
 
 void IoTropolisGui::showAboutDialog()
@@ -0,0 +1,310 @@
+#include "ingest/SampleStore.h"
+#include "metrics/MemoryStats.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+namespace {
+
+template <typename Ring>
+qint64 ringBytes(const Ring& ring)
+{
+    return MemoryStats::HashNodeOverhead + qint64(sizeof(Ring)) + MemoryStats::ArrayHeader +
+           qint64(ring.buf.capacity()) * qint64(sizeof(ring.buf.front()));
+}
+
+} // namespace
+
+SampleStore::SampleStore(int rawCapacity, int windowCapacity)
+    : m_rawCapacity(std::max(1, rawCapacity))
+    , m_windowCapacity(std::max(1, windowCapacity))
+{
+}
+
+void SampleStore::setCapacity(int rawCapacity, int windowCapacity)
+{
+    QWriteLocker locker(&m_lock);
+
+    rawCapacity = std::max(1, rawCapacity);
+    windowCapacity = std::max(1, windowCapacity);
+
+    if (rawCapacity != m_rawCapacity) {
+        for (auto& ring : m_raw)
+            ring.resize(rawCapacity);
+        m_rawCapacity = rawCapacity;
+    }
+
+    if (windowCapacity != m_windowCapacity) {
+        for (auto& windows : m_windows)
+            for (auto& ring : windows)
+                ring.resize(windowCapacity);
+        m_windowCapacity = windowCapacity;
+    }
+}
+
+void SampleStore::setRetention(qint64 retentionMs, int maxRetainedUnits)
+{
+    QWriteLocker locker(&m_lock);
+    m_retentionMs = std::max<qint64>(0, retentionMs);
+    m_maxRetainedUnits = std::max(0, maxRetainedUnits);
+
+    while (m_released.size() > m_maxRetainedUnits)
+        evictOldestLocked();
+}
+
+int SampleStore::resolutionIndex(qint64 resolutionMs)
+{
+    for (int r = 0; r < SensorAggregator::ResolutionCount; ++r) {
+        if (SensorAggregator::Resolutions[r] == resolutionMs)
+            return r;
+    }
+    return -1;
+}
+
+void SampleStore::appendSamples(const SensorSample* samples, int count)
+{
+    QWriteLocker locker(&m_lock);
+
+    quint64 lastKey = ~quint64(0);
+    Ring<RawPoint>* ring = nullptr;
+
+    for (int i = 0; i < count; ++i) {
+        const SensorSample& s = samples[i];
+        const quint64 key = seriesKey(s.unitID, s.sensorIndex);
+
+        // Batches are grouped by series; only hash on series change
+        if (key != lastKey) {
+            lastKey = key;
+            ring = nullptr;
+            if (!m_sensorNames.contains(s.unitID))
+                continue;
+            ring = &m_raw[key];
+            if (ring->capacity == 0)
+                ring->capacity = m_rawCapacity;
+        }
+        if (ring)
+            ring->push({s.timestampMs, s.value});
+    }
+}
+
+void SampleStore::appendWindows(const ClosedWindowBatch& windows)
+{
+    QWriteLocker locker(&m_lock);
+
+    for (const auto& w : windows) {
+        const int r = resolutionIndex(w.resolutionMs);
+        if (r < 0 || !m_sensorNames.contains(w.unitID))
+            continue;
+
+        Ring<ClosedWindow>& ring = m_windows[r][seriesKey(w.unitID, w.sensorIndex)];
+        if (ring.capacity == 0)
+            ring.capacity = m_windowCapacity;
+        ring.push(w);
+    }
+}
+
+// ------------------------------------------------------------
+// RANGE READS
+// ------------------------------------------------------------
+template <typename T, typename TimeOf>
+quint64 SampleStore::readRing(const Ring<T>& ring, qint64 fromMs, qint64 toMs,
+                              quint64 cursor, int max, QVector<T>* out, TimeOf timeOf)
+{
+    const quint64 oldest = ring.pushed - quint64(ring.size);
+    quint64 seq = std::max(cursor, oldest);
+
+    // Units may report slightly out of order, so filter rather than stop
+    for (; seq < ring.pushed && out->size() < max; ++seq) {
+        const T& v = ring.at(int(seq - oldest));
+        const qint64 ts = timeOf(v);
+        if (ts >= fromMs && ts <= toMs)
+            out->append(v);
+    }
+    return seq;
+}
+
+quint64 SampleStore::readRaw(UnitID unitID, quint16 sensorIndex,
+                             qint64 fromMs, qint64 toMs,
+                             quint64 cursor, int maxPoints,
+                             QVector<RawPoint>* out) const
+{
+    QReadLocker locker(&m_lock);
+
+    auto it = m_raw.constFind(seriesKey(unitID, sensorIndex));
+    if (it == m_raw.constEnd())
+        return cursor;
+
+    return readRing(it.value(), fromMs, toMs, cursor, maxPoints, out,
+                    [](const RawPoint& p) { return p.timestampMs; });
+}
+
+quint64 SampleStore::readWindows(UnitID unitID, quint16 sensorIndex, qint64 resolutionMs,
+                                 qint64 fromMs, qint64 toMs,
+                                 quint64 cursor, int maxWindows,
+                                 QVector<ClosedWindow>* out) const
+{
+    const int r = resolutionIndex(resolutionMs);
+    if (r < 0)
+        return cursor;
+
+    QReadLocker locker(&m_lock);
+
+    auto it = m_windows[r].constFind(seriesKey(unitID, sensorIndex));
+    if (it == m_windows[r].constEnd())
+        return cursor;
+
+    return readRing(it.value(), fromMs, toMs, cursor, maxWindows, out,
+                    [](const ClosedWindow& w) { return w.startMs; });
+}
+
+// ------------------------------------------------------------
+// SERIES NAMES
+// ------------------------------------------------------------
+void SampleStore::describeUnit(UnitID unitID, const QStringList& sensorNames)
+{
+    QWriteLocker locker(&m_lock);
+
+    // Back before its history expired: it is live again
+    auto released = m_releasedAt.find(unitID);
+    if (released != m_releasedAt.end()) {
+        m_released.remove(released.value(), unitID);
+        m_releasedAt.erase(released);
+    }
+
+    auto it = m_sensorNames.find(unitID);
+    if (it == m_sensorNames.end()) {
+        m_sensorNames.insert(unitID, sensorNames);
+        return;
+    }
+    if (it.value() == sensorNames)
+        return;
+
+    // Sensor indexes now mean something else; the old history cannot be
+    // attributed to the new sensors
+    dropSeriesLocked(unitID, it.value().size());
+    it.value() = sensorNames;
+}
+
+void SampleStore::dropSeriesLocked(UnitID unitID, int sensorCount)
+{
+    for (int i = 0; i < sensorCount; ++i) {
+        const quint64 key = seriesKey(unitID, quint16(i));
+        m_raw.remove(key);
+        for (auto& windows : m_windows)
+            windows.remove(key);
+    }
+}
+
+void SampleStore::evictOldestLocked()
+{
+    auto oldest = m_released.begin();
+    const UnitID unitID = oldest.value();
+    m_released.erase(oldest);
+    m_releasedAt.remove(unitID);
+
+    dropSeriesLocked(unitID, m_sensorNames.value(unitID).size());
+    m_sensorNames.remove(unitID);
+    ++m_evictedUnits;
+}
+
+// ------------------------------------------------------------
+// RETENTION
+// ------------------------------------------------------------
+void SampleStore::releaseUnit(UnitID unitID, qint64 nowMs)
+{
+    QWriteLocker locker(&m_lock);
+
+    if (!m_sensorNames.contains(unitID) || m_releasedAt.contains(unitID))
+        return;
+
+    m_released.insert(nowMs, unitID);
+    m_releasedAt.insert(unitID, nowMs);
+
+    // Over the cap: the longest-gone units go first
+    while (m_released.size() > m_maxRetainedUnits)
+        evictOldestLocked();
+}
+
+void SampleStore::expire(qint64 nowMs)
+{
+    QWriteLocker locker(&m_lock);
+
+    while (!m_released.isEmpty() && nowMs - m_released.firstKey() >= m_retentionMs)
+        evictOldestLocked();
+}
+
+bool SampleStore::containsUnit(UnitID unitID) const
+{
+    QReadLocker locker(&m_lock);
+    return m_sensorNames.contains(unitID);
+}
+
+int SampleStore::sensorIndex(UnitID unitID, const QString& sensorName) const
+{
+    QReadLocker locker(&m_lock);
+    return m_sensorNames.value(unitID).indexOf(sensorName);
+}
+
+int SampleStore::seriesCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_raw.size();
+}
+
+int SampleStore::retainedUnitCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_released.size();
+}
+
+quint64 SampleStore::evictedUnits() const
+{
+    QReadLocker locker(&m_lock);
+    return m_evictedUnits;
+}
+
+qint64 SampleStore::memoryBytes() const
+{
+    QReadLocker locker(&m_lock);
+    return bytesOf(false);
+}
+
+qint64 SampleStore::retainedMemoryBytes() const
+{
+    QReadLocker locker(&m_lock);
+    return bytesOf(true);
+}
+
+// Walks the series of every unit on one side of the connected/retained
+// split; called with the lock held
+qint64 SampleStore::bytesOf(bool retained) const
+{
+    qint64 bytes = 0;
+    for (auto it = m_sensorNames.constBegin(); it != m_sensorNames.constEnd(); ++it) {
+        if (m_releasedAt.contains(it.key()) != retained)
+            continue;
+
+        const QStringList& names = it.value();
+        bytes += MemoryStats::HashNodeOverhead + MemoryStats::ArrayHeader +
+                 names.size() * qint64(sizeof(void*));
+        for (const auto& name : names)
+            bytes += MemoryStats::bytes(name);
+
+        for (int i = 0; i < names.size(); ++i) {
+            const quint64 key = seriesKey(it.key(), quint16(i));
+            auto raw = m_raw.constFind(key);
+            if (raw != m_raw.constEnd())
+                bytes += ringBytes(raw.value());
+            for (const auto& windows : m_windows) {
+                auto w = windows.constFind(key);
+                if (w != windows.constEnd())
+                    bytes += ringBytes(w.value());
+            }
+        }
+    }
+    if (retained)
+        bytes += m_released.size() * 2 * (MemoryStats::HashNodeOverhead + qint64(sizeof(qint64) + sizeof(UnitID)));
+    return bytes;
+}
@@ -0,0 +1,363 @@
+#include "ingest/SensorAggregator.h"
+#include "metrics/MemoryStats.h"
+
+#include <algorithm>
+
+namespace {
+
+qint64 windowStartFor(qint64 timestampMs, qint64 widthMs)
+{
+    qint64 rem = timestampMs % widthMs;
+    if (rem < 0)
+        rem += widthMs;
+    return timestampMs - rem;
+}
+
+// Position of a 1s window in its series' pane ring
+size_t paneFor(qint64 windowStartMs)
+{
+    qint64 pane = (windowStartMs / 1000) % SensorAggregator::SlidingPanes;
+    if (pane < 0)
+        pane += SensorAggregator::SlidingPanes;
+    return size_t(pane);
+}
+
+} // namespace
+
+SensorAggregator::SensorAggregator(QObject* parent)
+    : QObject(parent)
+{
+    for (int r = 0; r < ResolutionCount; ++r)
+        m_banks[r].widthMs = Resolutions[r];
+}
+
+// ------------------------------------------------------------
+// BATCH KERNEL
+// Four independent accumulators and branch-free min/max so the
+// compiler can keep the loop in vector registers.
+// ------------------------------------------------------------
+SensorAggregator::BatchStats SensorAggregator::reduceBatch(const double* values, int n)
+{
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    double mn0 = values[0], mn1 = values[0], mn2 = values[0], mn3 = values[0];
+    double mx0 = values[0], mx1 = values[0], mx2 = values[0], mx3 = values[0];
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += values[i];     s1 += values[i + 1];
+        s2 += values[i + 2]; s3 += values[i + 3];
+        mn0 = std::min(mn0, values[i]);     mn1 = std::min(mn1, values[i + 1]);
+        mn2 = std::min(mn2, values[i + 2]); mn3 = std::min(mn3, values[i + 3]);
+        mx0 = std::max(mx0, values[i]);     mx1 = std::max(mx1, values[i + 1]);
+        mx2 = std::max(mx2, values[i + 2]); mx3 = std::max(mx3, values[i + 3]);
+    }
+    for (; i < n; ++i) {
+        s0 += values[i];
+        mn0 = std::min(mn0, values[i]);
+        mx0 = std::max(mx0, values[i]);
+    }
+
+    return { (s0 + s1) + (s2 + s3),
+             std::min(std::min(mn0, mn1), std::min(mn2, mn3)),
+             std::max(std::max(mx0, mx1), std::max(mx2, mx3)) };
+}
+
+// ------------------------------------------------------------
+// INGEST
+// ------------------------------------------------------------
+void SensorAggregator::ingest(const SensorSample* samples, int count)
+{
+    int i = 0;
+    while (i < count) {
+        const SensorSample& first = samples[i];
+        const qint64 second = windowStartFor(first.timestampMs, 1000);
+
+        // Extend the run while the series and the 1s window stay the same;
+        // a run then falls into exactly one window of every resolution.
+        int j = i + 1;
+        while (j < count &&
+               samples[j].unitID == first.unitID &&
+               samples[j].sensorIndex == first.sensorIndex &&
+               windowStartFor(samples[j].timestampMs, 1000) == second)
+            ++j;
+
+        const int n = j - i;
+        const int slot = slotFor(first.unitID, first.sensorIndex);
+
+        // A run whose window is already closed (or passed) at any resolution
+        // is dropped everywhere, so every resolution sees the same samples
+        qint64 starts[ResolutionCount];
+        bool late = false;
+        for (int r = 0; r < ResolutionCount; ++r) {
+            const WindowBank& bank = m_banks[r];
+            starts[r] = windowStartFor(first.timestampMs, bank.widthMs);
+            if (starts[r] <= bank.closed[slot] ||
+                (bank.count[slot] != 0 && starts[r] < bank.start[slot]))
+                late = true;
+        }
+        if (late) {
+            m_lateSamples += quint64(n);
+            i = j;
+            continue;
+        }
+
+        m_scratch.resize(n);
+        for (int k = 0; k < n; ++k)
+            m_scratch[k] = samples[i + k].value;
+        const BatchStats stats = reduceBatch(m_scratch.data(), n);
+
+        for (int r = 0; r < ResolutionCount; ++r) {
+            WindowBank& bank = m_banks[r];
+            if (bank.count[slot] != 0 && starts[r] > bank.start[slot])
+                closeWindow(r, slot);
+
+            accumulate(bank, slot, starts[r], stats, n);
+        }
+
+        i = j;
+    }
+
+    emitPending();
+}
+
+void SensorAggregator::accumulate(WindowBank& bank, int slot, qint64 windowStart,
+                                  const BatchStats& stats, quint64 n)
+{
+    if (bank.count[slot] == 0) {
+        bank.start[slot] = windowStart;
+        bank.count[slot] = n;
+        bank.sum[slot]   = stats.sum;
+        bank.min[slot]   = stats.min;
+        bank.max[slot]   = stats.max;
+        return;
+    }
+
+    bank.count[slot] += n;
+    bank.sum[slot]   += stats.sum;
+    bank.min[slot]    = std::min(bank.min[slot], stats.min);
+    bank.max[slot]    = std::max(bank.max[slot], stats.max);
+}
+
+// ------------------------------------------------------------
+// WINDOW CLOSING
+// ------------------------------------------------------------
+void SensorAggregator::closeWindow(int bankIndex, int slot)
+{
+    WindowBank& bank = m_banks[bankIndex];
+    if (bank.count[slot] == 0)
+        return;
+
+    const quint64 key = m_slotKey[slot];
+
+    ClosedWindow w;
+    w.unitID       = UnitID(key >> 16);
+    w.sensorIndex  = quint16(key & 0xFFFF);
+    w.resolutionMs = bank.widthMs;
+    w.startMs      = bank.start[slot];
+    w.count        = bank.count[slot];
+    w.min          = bank.min[slot];
+    w.max          = bank.max[slot];
+    w.mean         = bank.sum[slot] / double(bank.count[slot]);
+    m_pending.append(w);
+
+    if (bankIndex == 0) {
+        const size_t pane = size_t(slot) * SlidingPanes + paneFor(bank.start[slot]);
+        m_panes.start[pane] = bank.start[slot];
+        m_panes.count[pane] = bank.count[slot];
+        m_panes.sum[pane]   = bank.sum[slot];
+        m_panes.min[pane]   = bank.min[slot];
+        m_panes.max[pane]   = bank.max[slot];
+    }
+
+    bank.closed[slot] = bank.start[slot];
+    bank.count[slot] = 0;
+}
+
+void SensorAggregator::flushExpired(qint64 nowMs)
+{
+    for (int r = 0; r < ResolutionCount; ++r) {
+        const WindowBank& bank = m_banks[r];
+        const qint64 cutoff = nowMs - bank.widthMs - FlushGraceMs;
+        const size_t slotCount = bank.start.size();
+
+        for (size_t s = 0; s < slotCount; ++s) {
+            if (bank.count[s] != 0 && bank.start[s] <= cutoff)
+                closeWindow(r, int(s));
+        }
+    }
+
+    emitPending();
+    pruneClosedMarks(nowMs);
+}
+
+void SensorAggregator::emitPending()
+{
+    if (m_pending.isEmpty())
+        return;
+
+    ClosedWindowBatch out;
+    out.swap(m_pending);
+    emit windowsClosed(out);
+}
+
+// ------------------------------------------------------------
+// SERIES SLOTS
+// ------------------------------------------------------------
+int SensorAggregator::slotFor(UnitID unitID, quint16 sensorIndex)
+{
+    const quint64 key = seriesKey(unitID, sensorIndex);
+    auto it = m_seriesIndex.constFind(key);
+    if (it != m_seriesIndex.constEnd())
+        return it.value();
+
+    int slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_slotKey[slot] = key;
+    } else {
+        slot = int(m_slotKey.size());
+        m_slotKey.push_back(key);
+
+        for (auto& bank : m_banks) {
+            bank.start.push_back(0);
+            bank.closed.push_back(m_closedFloor);
+            bank.count.push_back(0);
+            bank.sum.push_back(0.0);
+            bank.min.push_back(0.0);
+            bank.max.push_back(0.0);
+        }
+
+        const size_t panes = m_panes.start.size() + SlidingPanes;
+        m_panes.start.resize(panes, 0);
+        m_panes.count.resize(panes, 0);
+        m_panes.sum.resize(panes, 0.0);
+        m_panes.min.resize(panes, 0.0);
+        m_panes.max.resize(panes, 0.0);
+    }
+
+    // A series seen before resumes after the windows it already emitted
+    auto mark = m_closedMarks.find(key);
+    for (int r = 0; r < ResolutionCount; ++r)
+        m_banks[r].closed[slot] = mark != m_closedMarks.end() ? mark.value().start[r] : m_closedFloor;
+    if (mark != m_closedMarks.end())
+        m_closedMarks.erase(mark);
+
+    std::fill_n(m_panes.count.begin() + size_t(slot) * SlidingPanes, SlidingPanes, quint64(0));
+
+    m_seriesIndex.insert(key, slot);
+    m_unitSlots[unitID].append(slot);
+    return slot;
+}
+
+void SensorAggregator::dropUnit(UnitID unitID)
+{
+    const QVector<int> unitSlots = m_unitSlots.take(unitID);
+    for (int slot : unitSlots) {
+        ClosedMarks mark;
+        for (int r = 0; r < ResolutionCount; ++r) {
+            closeWindow(r, slot);
+            mark.start[r] = m_banks[r].closed[slot];
+        }
+
+        m_closedMarks.insert(m_slotKey[slot], mark);
+        m_seriesIndex.remove(m_slotKey[slot]);
+        m_freeSlots.push_back(slot);
+    }
+
+    emitPending();
+}
+
+// Marks are only needed while a reconnecting unit could still send
+// samples for their windows; older ones fold into m_closedFloor
+void SensorAggregator::pruneClosedMarks(qint64 nowMs)
+{
+    if (m_closedMarks.isEmpty() || nowMs < m_nextMarkPruneMs)
+        return;
+    m_nextMarkPruneMs = nowMs + Resolutions[1];
+
+    constexpr int Widest = ResolutionCount - 1;
+    const qint64 cutoff = nowMs - ClosedMarkRetentionMs;
+    for (auto it = m_closedMarks.begin(); it != m_closedMarks.end();) {
+        // The widest window covers every narrower one that was emitted
+        if (it.value().start[Widest] < cutoff) {
+            m_closedFloor = std::max(m_closedFloor, it.value().start[Widest]);
+            it = m_closedMarks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// SLIDING VIEW
+// ------------------------------------------------------------
+SensorAggregator::WindowStats SensorAggregator::sliding(UnitID unitID, quint16 sensorIndex,
+                                                        qint64 nowMs) const
+{
+    WindowStats out;
+
+    auto it = m_seriesIndex.constFind(seriesKey(unitID, sensorIndex));
+    if (it == m_seriesIndex.constEnd())
+        return out;
+
+    const int slot = it.value();
+    const qint64 from = nowMs - SlidingWidthMs;
+
+    double sum = 0.0;
+    double mn = std::numeric_limits<double>::infinity();
+    double mx = -std::numeric_limits<double>::infinity();
+
+    const size_t base = size_t(slot) * SlidingPanes;
+    for (size_t p = base; p < base + SlidingPanes; ++p) {
+        if (m_panes.count[p] == 0 || m_panes.start[p] < from || m_panes.start[p] > nowMs)
+            continue;
+        out.count += m_panes.count[p];
+        sum += m_panes.sum[p];
+        mn = std::min(mn, m_panes.min[p]);
+        mx = std::max(mx, m_panes.max[p]);
+    }
+
+    // The still-open 1s window belongs to the view as well
+    const WindowBank& fine = m_banks[0];
+    if (fine.count[slot] != 0 && fine.start[slot] >= from && fine.start[slot] <= nowMs) {
+        out.count += fine.count[slot];
+        sum += fine.sum[slot];
+        mn = std::min(mn, fine.min[slot]);
+        mx = std::max(mx, fine.max[slot]);
+    }
+
+    if (out.count != 0) {
+        out.min  = mn;
+        out.max  = mx;
+        out.mean = sum / double(out.count);
+    }
+    return out;
+}
+
+// ------------------------------------------------------------
+// MEMORY ACCOUNTING
+// ------------------------------------------------------------
+qint64 SensorAggregator::memoryBytes() const
+{
+    auto capacity = [](const auto& v) {
+        return qint64(v.capacity()) * qint64(sizeof(v[0]));
+    };
+
+    qint64 bytes = 0;
+    for (const auto& bank : m_banks)
+        bytes += capacity(bank.start) + capacity(bank.closed) + capacity(bank.count) +
+                 capacity(bank.sum) + capacity(bank.min) + capacity(bank.max);
+
+    bytes += capacity(m_panes.start) + capacity(m_panes.count) + capacity(m_panes.sum) +
+             capacity(m_panes.min) + capacity(m_panes.max);
+
+    bytes += m_seriesIndex.size() * (MemoryStats::HashNodeOverhead + qint64(sizeof(quint64) + sizeof(int)));
+    bytes += m_closedMarks.size() * (MemoryStats::HashNodeOverhead + qint64(sizeof(quint64) + sizeof(ClosedMarks)));
+    for (const auto& unitSlots : m_unitSlots)
+        bytes += MemoryStats::HashNodeOverhead + MemoryStats::ArrayHeader + capacity(unitSlots);
+
+    bytes += capacity(m_slotKey) + capacity(m_freeSlots) + capacity(m_scratch) +
+             capacity(m_pending);
+    return bytes;
+}
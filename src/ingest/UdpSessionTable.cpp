@@ -0,0 +1,34 @@
+#include "ingest/UdpSessionTable.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+void UdpSessionTable::insert(UnitID unitID, const Session& session)
+{
+    QWriteLocker locker(&m_lock);
+    m_sessions.insert(unitID, session);
+}
+
+void UdpSessionTable::remove(UnitID unitID)
+{
+    QWriteLocker locker(&m_lock);
+    m_sessions.remove(unitID);
+}
+
+bool UdpSessionTable::lookup(UnitID unitID, quint64 token, Session* out) const
+{
+    QReadLocker locker(&m_lock);
+
+    auto it = m_sessions.constFind(unitID);
+    if (it == m_sessions.constEnd() || it->token != token)
+        return false;
+
+    *out = it.value();
+    return true;
+}
+
+int UdpSessionTable::size() const
+{
+    QReadLocker locker(&m_lock);
+    return m_sessions.size();
+}
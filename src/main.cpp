@@ -1,9 +1,19 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QLoggingCategory>
+
+#include <memory>
 
 #include "registration/IoTropolisRegistrationServer.h"
 #include "gui/IoTropolisGui.h"
 #include "config/IoTropolisConfig.h"
+#include "config/IoTropolisConfigReloader.h"
+#include "query/IoTropolisQueryServer.h"
+#include "persistence/RegistryPersistence.h"
+#include "replication/IoTropolisReplicationNode.h"
+#include "capture/SessionRecorder.h"
+#include "metrics/MemoryMonitor.h"
 
 QString resolveConfigPath(int argc, char* argv[])
 {
@@ -14,30 +24,202 @@ QString resolveConfigPath(int argc, char* argv[])
 
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
-
-    // --- Load configuration ---
+    // --- Load configuration (decides between GUI and headless) ---
     const QString configPath = resolveConfigPath(argc, argv);
     IoTropolisConfig config(configPath);
 
+    std::unique_ptr<QCoreApplication> app;
+    if (config.guiEnabled())
+        app.reset(new QApplication(argc, argv));
+    else
+        app.reset(new QCoreApplication(argc, argv));
+
+    QString configError;
+    if (!config.validate(&configError)) {
+        // Same rule as a reload: invalid settings are never put into effect
+        qCritical() << "[IoTropolisConfig] Invalid configuration:" << configError;
+        return 1;
+    }
+
+    if (!config.loggingRules().isEmpty())
+        QLoggingCategory::setFilterRules(config.loggingRules());
+
+    // --- Connection backend; epoll is only offered headless ---
+    auto transport = IoTropolisRegistrationServer::Transport::Qt;
+    if (config.transport() == "epoll") {
+        if (config.guiEnabled())
+            qWarning() << "[IoTropolis] epoll transport requires gui/enable=false; using Qt sockets";
+        else
+            transport = IoTropolisRegistrationServer::Transport::Epoll;
+    }
+
+    // --- Optional protocol capture (replay with iotropolis-replay) ---
+    // Declared first: connections record until the server is gone
+    SessionRecorder recorder;
+    if (config.captureEnabled())
+        recorder.start(config.captureFile());
+
     // --- Create server using unit type directory from config ---
     IoTropolisRegistrationServer server(config.unitTypeDir());
+    if (recorder.isRecording())
+        server.setSessionRecorder(&recorder);
+    server.setSampleHistory(config.rawSamplesPerSensor(),
+                            config.windowsPerResolution());
+    server.setSampleRetention(config.retentionSec(), config.maxRetainedUnits());
+    server.setAdmissionSettings(config.admission());
+
+    // --- Node identity: UnitIDs are partitioned per node ---
+    server.registry()->setNodeID(config.nodeID());
+
+    // --- Warm restart: restore UnitID allocator and identities ---
+    RegistryPersistence persistence(server.registry(), config.stateDir());
+    if (config.persistenceEnabled()) {
+        if (!persistence.restore()) {
+            qCritical() << "[IoTropolisPersistence] Cannot read registry state in"
+                        << config.stateDir()
+                        << "; refusing to start rather than overwrite it";
+            return 1;
+        }
+        persistence.start(config.snapshotIntervalSec());
+    }
+
+    // --- Optional UDP sample ingest for registered units ---
+    if (config.udpEnabled() &&
+        !server.startUdpIngest(config.bindAddress(), config.udpPort(), config.udpThreads())) {
+        qWarning() << "UDP ingest disabled";
+    }
 
     // --- Start server with port from config ---
-    if (!server.start(config.tcpPort())) {
+    if (!server.start(config.bindAddress(), config.tcpPort(), transport)) {
         qCritical() << "Failed to start IoTropolis server";
         return 1;
     }
 
-    IoTropolisGui gui;
+    // --- Registry replication with peer nodes ---
+    IoTropolisReplicationNode replication(server.registry(), server.typeCatalog());
+    replication.setSharedSecret(config.replicationSecret());
+    if (config.replicationEnabled() &&
+        !replication.start(config.replicationBindAddress(), config.replicationPort(),
+                           config.replicationPeers())) {
+        qWarning() << "Replication disabled";
+    }
+
+    // --- Local query endpoint (answers from registry + sample store) ---
+    IoTropolisQueryServer queryServer(server.registry(), server.sampleStore());
+    if (config.queryEnabled() &&
+        !queryServer.start(config.querySocket(), config.queryWorkers())) {
+        qWarning() << "Query endpoint disabled";
+    }
+
+    std::unique_ptr<IoTropolisGui> gui;
+    if (config.guiEnabled())
+        gui.reset(new IoTropolisGui);
+
+    // --- Memory accounting (STATS / METRICS on the query endpoint, GUI) ---
+    // A report walks every connection, so it is only collected for a
+    // reader: on request, or on the timer while the GUI or the metrics
+    // log is there to show it
+    MemoryMonitor memory;
+    memory.addSubsystem("registry",     [&server] { return server.registry()->memoryBytes(); });
+    memory.addSubsystem("type_catalog", [&server] { return server.typeCatalog()->memoryBytes(); });
+    memory.addSubsystem("sample_store", [&server] { return server.sampleStore()->memoryBytes(); });
+    memory.addSubsystem("sample_store_retained",
+                        [&server] { return server.sampleStore()->retainedMemoryBytes(); });
+    memory.addSubsystem("aggregator",   [&server] { return server.aggregator()->memoryBytes(); });
+    memory.addSubsystem("capture",      [&recorder] { return recorder.memoryBytes(); });
+    memory.setConnectionProvider([&server](int topN, MemoryReport* report) {
+        server.collectConnectionMemory(topN, report);
+    });
+    if (gui) {
+        memory.addSubsystem("gui", [&gui] { return gui->memoryBytes(); });
+        QObject::connect(gui.get(), &IoTropolisGui::memoryReportRequested,
+                         &memory, [&] { gui->showMemoryReport(memory.collect()); });
+    }
+
+    const auto applyMetricsInterval = [&memory, &gui](const IoTropolisConfig& cfg) {
+        memory.setInterval(gui || cfg.metricsLog() ? cfg.metricsIntervalSec() : 0);
+    };
+    applyMetricsInterval(config);
+
+    queryServer.addControlCommand("STATS", [&memory](const QByteArray& args) -> QByteArray {
+        int topN = MemoryMonitor::DefaultTopConnections;
+        for (const QByteArray& arg : args.split(' ')) {
+            if (!arg.startsWith("top="))
+                continue;
+            bool ok = false;
+            topN = arg.mid(4).toInt(&ok);
+            if (!ok || topN < 0)
+                return QByteArray("ERROR Invalid top: ") + arg.mid(4) + "\n";
+            topN = qMin(topN, int(MemoryMonitor::MaxTopConnections));
+        }
+        return memory.collect(topN).toQueryRows();
+    });
+
+    queryServer.addControlCommand("METRICS", [&memory](const QByteArray&) -> QByteArray {
+        const QByteArray text = memory.collect().toPrometheus();
+        return text + "END " + QByteArray::number(text.count('\n')) + "\n";
+    });
+
+    // --- Live reload (SIGHUP or RELOAD on the query endpoint) ---
+    // Subsystems apply only the settings that changed and can change online;
+    // the rest waits for a restart. Readers of the rest use current().
+    IoTropolisConfigReloader reloader(configPath,
+                                      std::make_shared<const IoTropolisConfig>(config));
+    QObject::connect(&reloader, &IoTropolisConfigReloader::configChanged,
+                     &server,
+                     [&](const IoTropolisConfigPtr& cfg, const IoTropolisConfigPtr& previous) {
+        if (cfg->loggingRules() != previous->loggingRules())
+            QLoggingCategory::setFilterRules(cfg->loggingRules());
+        if (cfg->admission() != previous->admission())
+            server.setAdmissionSettings(cfg->admission());
+        if (cfg->rawSamplesPerSensor() != previous->rawSamplesPerSensor() ||
+            cfg->windowsPerResolution() != previous->windowsPerResolution())
+            server.setSampleHistory(cfg->rawSamplesPerSensor(),
+                                    cfg->windowsPerResolution());
+        if (cfg->retentionSec() != previous->retentionSec() ||
+            cfg->maxRetainedUnits() != previous->maxRetainedUnits())
+            server.setSampleRetention(cfg->retentionSec(), cfg->maxRetainedUnits());
+        if (cfg->unitTypeDir() != previous->unitTypeDir())
+            server.typeCatalog()->setDirectory(cfg->unitTypeDir());
+        if (cfg->queryWorkers() != previous->queryWorkers())
+            queryServer.setWorkerCount(cfg->queryWorkers());
+        if (cfg->metricsIntervalSec() != previous->metricsIntervalSec() ||
+            cfg->metricsLog() != previous->metricsLog())
+            applyMetricsInterval(*cfg);
+    });
+    reloader.watchSighup();
+
+    queryServer.addControlCommand("RELOAD", [&reloader](const QByteArray&) -> QByteArray {
+        QString error;
+        if (!reloader.reload(&error))
+            return QByteArray("ERROR ") + error.toUtf8() + "\n";
+
+        // Settings the reload left for the next restart
+        QByteArray rows;
+        const QStringList pending = reloader.pendingRestart();
+        for (const QString& key : pending)
+            rows += "RESTART " + key.toUtf8() + "\n";
+        return rows + "END " + QByteArray::number(pending.size()) + "\n";
+    });
+
+    QObject::connect(&memory, &MemoryMonitor::reportReady,
+                     &server,
+                     [&](const MemoryReport& report) {
+        if (gui)
+            gui->showMemoryReport(report);
+
+        if (reloader.current()->metricsLog())
+            qDebug().noquote() << "[IoTropolisMetrics] memory:" << report.summary();
+    });
 
     // ---- Unit fully registered (safe: unit fully alive) ----
     QObject::connect(&server,
                      &IoTropolisRegistrationServer::unitFullyRegistered,
-                     &gui,
+                     &server,
                      [&](IoTropolisUnitConnection* unit) {
 
-        gui.addUnit(unit);
+        if (gui)
+            gui->addUnit(unit);
 
         qDebug() << "[IoTropolis] Unit fully registered:"
                  << unit->unitType()
@@ -50,10 +232,13 @@ int main(int argc, char *argv[])
     // ---- Unit about to be removed (safe: last chance to read state) ----
     QObject::connect(&server,
                      &IoTropolisRegistrationServer::unitAboutToBeRemoved,
-                     &gui,
+                     &server,
                      [&](IoTropolisUnitConnection* unit) {
 
-        gui.removeUnit(unit);
+        if (!gui)
+            return;
+
+        gui->removeUnit(unit);
 
         qDebug() << "[IoTropolis] Unit removed from GUI:"
                  << unit->unitID()
@@ -68,6 +253,7 @@ int main(int argc, char *argv[])
                          qDebug() << "[IoTropolis] Unit disconnected (transport-level)";
                      });
 
-    gui.show();
-    return app.exec();
+    if (gui)
+        gui->show();
+    return app->exec();
 }
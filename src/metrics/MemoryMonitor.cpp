@@ -0,0 +1,48 @@
+#include "metrics/MemoryMonitor.h"
+
+#include <QDateTime>
+
+MemoryMonitor::MemoryMonitor(QObject* parent)
+    : QObject(parent)
+{
+    connect(&m_timer, &QTimer::timeout, this, &MemoryMonitor::onTimer);
+}
+
+void MemoryMonitor::addSubsystem(const QByteArray& name, SizeProvider provider)
+{
+    m_providers.append({name, std::move(provider)});
+}
+
+void MemoryMonitor::setConnectionProvider(ConnectionProvider provider)
+{
+    m_connections = std::move(provider);
+}
+
+MemoryReport MemoryMonitor::collect(int topN) const
+{
+    MemoryReport report;
+    report.collectedAtMs = QDateTime::currentMSecsSinceEpoch();
+
+    report.subsystems.reserve(m_providers.size());
+    for (const auto& p : m_providers)
+        report.subsystems.append({p.name, p.size()});
+
+    if (m_connections)
+        m_connections(qBound(0, topN, MaxTopConnections), &report);
+
+    return report;
+}
+
+void MemoryMonitor::setInterval(int intervalSec)
+{
+    if (intervalSec <= 0) {
+        m_timer.stop();
+        return;
+    }
+    m_timer.start(intervalSec * 1000);
+}
+
+void MemoryMonitor::onTimer()
+{
+    emit reportReady(collect());
+}
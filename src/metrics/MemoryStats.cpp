@@ -0,0 +1,119 @@
+#include "metrics/MemoryStats.h"
+
+namespace MemoryStats {
+
+qint64 bytes(const QString& s)
+{
+    if (s.isNull())
+        return 0;
+    return ArrayHeader + (qint64(s.capacity()) + 1) * qint64(sizeof(QChar));
+}
+
+qint64 bytes(const QByteArray& b)
+{
+    if (b.isNull())
+        return 0;
+    return ArrayHeader + qint64(b.capacity()) + 1;
+}
+
+qint64 bytes(const IOComponent& c)
+{
+    return bytes(c.name()) + bytes(c.format());
+}
+
+qint64 bytes(const QList<IOComponent>& list)
+{
+    if (list.isEmpty())
+        return 0;
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    // Qt 6 stores the elements themselves in one contiguous block
+    qint64 total = ArrayHeader + qint64(list.capacity()) * qint64(sizeof(IOComponent));
+#else
+    // Qt 5 stores large types as pointers to separately allocated nodes
+    qint64 total = ArrayHeader +
+                   qint64(list.size()) * qint64(sizeof(void*) + sizeof(IOComponent));
+#endif
+    for (const auto& c : list)
+        total += bytes(c);
+    return total;
+}
+
+} // namespace MemoryStats
+
+namespace {
+
+QString mib(qint64 bytes)
+{
+    return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 2) + " MiB";
+}
+
+} // namespace
+
+qint64 MemoryReport::totalBytes() const
+{
+    qint64 total = connectionBytes;
+    for (const auto& s : subsystems)
+        total += s.bytes;
+    return total;
+}
+
+QByteArray MemoryReport::toQueryRows() const
+{
+    QByteArray out;
+    int rows = 0;
+
+    out += "MEM total " + QByteArray::number(totalBytes()) + "\n";
+    out += "MEM connections " + QByteArray::number(connectionBytes) + ' ' +
+           QByteArray::number(connectionCount) + "\n";
+    rows += 2;
+
+    for (const auto& s : subsystems) {
+        out += "MEM " + s.name + ' ' + QByteArray::number(s.bytes) + "\n";
+        ++rows;
+    }
+
+    for (const auto& c : topConnections) {
+        out += "CONN " + QByteArray::number(c.unitID) + ' ' + c.ipAddress.toUtf8() + ' ' +
+               QByteArray::number(c.bytes) + "\n";
+        ++rows;
+    }
+
+    out += "END " + QByteArray::number(rows) + "\n";
+    return out;
+}
+
+QByteArray MemoryReport::toPrometheus() const
+{
+    QByteArray out;
+
+    out += "# HELP iotropolis_memory_bytes Approximate heap bytes per subsystem\n"
+           "# TYPE iotropolis_memory_bytes gauge\n";
+    out += "iotropolis_memory_bytes{subsystem=\"connections\"} " +
+           QByteArray::number(connectionBytes) + "\n";
+    for (const auto& s : subsystems)
+        out += "iotropolis_memory_bytes{subsystem=\"" + s.name + "\"} " +
+               QByteArray::number(s.bytes) + "\n";
+
+    out += "# HELP iotropolis_connections Open unit connections\n"
+           "# TYPE iotropolis_connections gauge\n"
+           "iotropolis_connections " + QByteArray::number(connectionCount) + "\n";
+
+    out += "# HELP iotropolis_connection_memory_bytes Heaviest unit connections\n"
+           "# TYPE iotropolis_connection_memory_bytes gauge\n";
+    for (const auto& c : topConnections)
+        out += "iotropolis_connection_memory_bytes{unit=\"" + QByteArray::number(c.unitID) +
+               "\",ip=\"" + c.ipAddress.toUtf8() + "\"} " + QByteArray::number(c.bytes) + "\n";
+
+    return out;
+}
+
+QString MemoryReport::summary() const
+{
+    QString line = QString("total %1, connections %2 (%3)")
+                       .arg(mib(totalBytes()), mib(connectionBytes))
+                       .arg(connectionCount);
+    for (const auto& s : subsystems)
+        line += QString(", %1 %2").arg(QString::fromUtf8(s.name), mib(s.bytes));
+    return line;
+}
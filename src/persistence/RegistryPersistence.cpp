@@ -0,0 +1,289 @@
+#include "persistence/RegistryPersistence.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr quint32 SnapshotMagic = 0x494F5453;   // "IOTS"
+constexpr quint16 SnapshotVersion = 2;        // 2: identity secrets
+constexpr QDataStream::Version StreamVersion = QDataStream::Qt_5_12;
+
+// Make a newly created file's directory entry durable as well
+bool syncDirectory(const QString& dir)
+{
+    const int fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+RegistryPersistence::RegistryPersistence(UnitRegistry* registry, const QString& dir)
+    : m_registry(registry)
+    , m_dir(dir)
+{
+}
+
+RegistryPersistence::~RegistryPersistence()
+{
+    stop();
+    m_self.reset();
+}
+
+QString RegistryPersistence::snapshotPath() const { return m_dir + "/registry.snapshot"; }
+QString RegistryPersistence::journalPath() const  { return m_dir + "/registry.journal"; }
+
+// ------------------------------------------------------------
+// RESTORE
+// ------------------------------------------------------------
+bool RegistryPersistence::restore()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    RegistrySnapshot snapshot;
+
+    QFile snapFile(snapshotPath());
+    if (snapFile.exists()) {
+        if (!snapFile.open(QIODevice::ReadOnly)) {
+            qWarning() << "[IoTropolisPersistence] Cannot open snapshot" << snapFile.fileName();
+            return false;
+        }
+
+        QDataStream in(&snapFile);
+        in.setVersion(StreamVersion);
+
+        quint32 magic = 0;
+        quint16 version = 0;
+        in >> magic >> version;
+        if (magic != SnapshotMagic || version < 1 || version > SnapshotVersion) {
+            qWarning() << "[IoTropolisPersistence] Snapshot" << snapFile.fileName()
+                       << "has wrong format";
+            return false;
+        }
+
+        in >> snapshot.seq >> snapshot.reservedUpTo >> snapshot.identities;
+        if (version >= 2)
+            in >> snapshot.identitySecrets;
+        if (in.status() != QDataStream::Ok) {
+            qWarning() << "[IoTropolisPersistence] Snapshot" << snapFile.fileName()
+                       << "is corrupted";
+            return false;
+        }
+    }
+    m_registry->restore(snapshot);
+
+    // Replay the journal. A torn record at the tail (crash mid-append) ends
+    // the replay; a complete record that does not decode is corruption.
+    int replayed = 0;
+    QFile journal(journalPath());
+    if (journal.exists() && !journal.open(QIODevice::ReadOnly)) {
+        qWarning() << "[IoTropolisPersistence] Cannot open journal" << journal.fileName();
+        return false;
+    }
+    if (journal.isOpen()) {
+        QDataStream in(&journal);
+        in.setVersion(StreamVersion);
+
+        while (!in.atEnd()) {
+            quint32 length = 0;
+            in >> length;
+            QByteArray payload(int(length), Qt::Uninitialized);
+            if (in.status() != QDataStream::Ok ||
+                in.readRawData(payload.data(), int(length)) != int(length)) {
+                qWarning() << "[IoTropolisPersistence] Truncated journal record, stopping replay";
+                break;
+            }
+
+            QDataStream rec(payload);
+            rec.setVersion(StreamVersion);
+            RegistryDelta delta;
+            rec >> delta;
+            if (rec.status() != QDataStream::Ok) {
+                qWarning() << "[IoTropolisPersistence] Corrupted journal record" << replayed
+                           << "in" << journal.fileName();
+                return false;
+            }
+
+            m_registry->replay(delta);
+            ++replayed;
+        }
+    }
+
+    qDebug() << "[IoTropolisPersistence] Restored" << snapshot.identities.size()
+             << "identities and" << replayed << "journal records in"
+             << timer.elapsed() << "ms";
+    return true;
+}
+
+// ------------------------------------------------------------
+// BACKGROUND WRITER
+// ------------------------------------------------------------
+void RegistryPersistence::start(int snapshotIntervalSec)
+{
+    if (m_thread)
+        return;
+
+    m_snapshotIntervalMs = qMax(1, snapshotIntervalSec) * 1000;
+
+    QDir d;
+    if (!d.exists(m_dir))
+        d.mkpath(m_dir);
+
+    if (!m_self) {
+        m_self = std::make_shared<RegistryPersistence*>(this);
+        std::weak_ptr<RegistryPersistence*> weak = m_self;
+        m_registry->addDeltaListener([weak](const RegistryDelta& d) {
+            if (auto self = weak.lock())
+                (*self)->onDelta(d);
+        });
+    }
+
+    m_running = true;
+    m_thread = QThread::create([this]() { writerLoop(); });
+    m_thread->start();
+}
+
+void RegistryPersistence::stop()
+{
+    if (!m_thread)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        m_wake.wakeAll();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+void RegistryPersistence::onDelta(const RegistryDelta& delta)
+{
+    // Only the allocator and identities are persisted here
+    if (delta.kind != RegistryDelta::Kind::IdentityBound &&
+        delta.kind != RegistryDelta::Kind::IdsReserved)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_running)
+            return;
+    }
+
+    // Synchronous: the caller uses the ID or secret as soon as we return
+    if (!appendJournal(delta))
+        qCritical() << "[IoTropolisPersistence] Delta" << delta.seq
+                    << "is not durable; a restart may reissue it";
+}
+
+void RegistryPersistence::writerLoop()
+{
+    QElapsedTimer sinceSnapshot;
+    sinceSnapshot.start();
+
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        if (m_running) {
+            const qint64 remaining = m_snapshotIntervalMs - sinceSnapshot.elapsed();
+            if (remaining > 0)
+                m_wake.wait(&m_mutex, ulong(remaining));
+        }
+
+        const bool running = m_running;
+        locker.unlock();
+
+        if (!running || sinceSnapshot.elapsed() >= m_snapshotIntervalMs) {
+            writeSnapshot();
+            sinceSnapshot.restart();
+        }
+
+        if (!running)
+            return;
+
+        locker.relock();
+    }
+}
+
+bool RegistryPersistence::appendJournal(const RegistryDelta& delta)
+{
+    QMutexLocker locker(&m_journalMutex);
+
+    QFile journal(journalPath());
+    const bool created = !journal.exists();
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "[IoTropolisPersistence] Cannot open journal" << journal.fileName();
+        return false;
+    }
+
+    QByteArray payload;
+    QDataStream rec(&payload, QIODevice::WriteOnly);
+    rec.setVersion(StreamVersion);
+    rec << delta;
+
+    QByteArray buffer;
+    QDataStream out(&buffer, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << quint32(payload.size());
+    out.writeRawData(payload.constData(), payload.size());
+
+    const bool ok = journal.write(buffer) == buffer.size() && journal.flush() &&
+                    ::fsync(journal.handle()) == 0 &&
+                    (!created || syncDirectory(m_dir));
+    if (!ok) {
+        qWarning() << "[IoTropolisPersistence] Journal write failed";
+        return false;
+    }
+
+    m_journaledSeq = qMax(m_journaledSeq, delta.seq);
+    return true;
+}
+
+bool RegistryPersistence::writeSnapshot()
+{
+    // Cheap: the registry hands out implicitly shared copies
+    const RegistrySnapshot snapshot = m_registry->snapshot();
+
+    QSaveFile file(snapshotPath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[IoTropolisPersistence] Cannot write snapshot" << file.fileName();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(StreamVersion);
+    out << SnapshotMagic << SnapshotVersion
+        << snapshot.seq << snapshot.reservedUpTo << snapshot.identities
+        << snapshot.identitySecrets;
+
+    if (!file.commit()) {
+        qWarning() << "[IoTropolisPersistence] Snapshot commit failed";
+        return false;
+    }
+
+    // The journal can start over once the snapshot covers every record in
+    // it. A delta journaled after the snapshot was taken keeps it until
+    // the next snapshot; replay skips the records the snapshot covers.
+    QMutexLocker locker(&m_journalMutex);
+    if (m_journaledSeq <= snapshot.seq) {
+        QFile journal(journalPath());
+        if (journal.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            journal.close();
+    }
+
+    return true;
+}
@@ -0,0 +1,579 @@
+#include "query/IoTropolisQueryServer.h"
+#include "registration/UnitRegistry.h"
+#include "ingest/SampleStore.h"
+
+#include <QRunnable>
+#include <QDateTime>
+#include <QHash>
+#include <QDebug>
+
+namespace {
+
+constexpr int ChunkRows = 512;
+constexpr qint64 MaxBufferedBytes = 1 << 20;
+constexpr qint64 MaxRequestLength = 4096;
+constexpr int MaxQueuedRequests = 64;
+constexpr qint64 MaxLastSec = MaxSampleTimestampMs / 1000;
+constexpr int StaleProbeTimeoutMs = 500;
+
+using QueryArgs = QHash<QByteArray, QByteArray>;
+
+} // namespace
+
+// ------------------------------------------------------------
+// QUERY TASK
+// Runs on the worker pool. Reads only through the thread-safe
+// registry/store APIs and hands results back in queued chunks.
+// When the reader falls behind the task yields instead of holding
+// its worker; the session resumes it once the socket drains.
+// ------------------------------------------------------------
+class QueryTask
+{
+public:
+    QueryTask(IoTropolisQuerySession* session,
+              const QByteArray& request,
+              const UnitRegistry* registry,
+              const SampleStore* store,
+              std::shared_ptr<QueryState> state)
+        : m_session(session)
+        , m_request(request)
+        , m_registry(registry)
+        , m_store(store)
+        , m_state(std::move(state))
+    {}
+
+    // Runs until the query completes or the reader is congested
+    void run();
+
+private:
+    enum class Kind { Units, Samples, Rollup };
+
+    bool cancelled() const { return m_state->cancelled.load(); }
+    bool congested() const { return m_state->pendingBytes.load() > MaxBufferedBytes; }
+
+    void row(const QByteArray& line);
+    void fail(const QByteArray& reason);
+    void flush();
+
+    bool prepare();
+    bool prepareUnits(const QueryArgs& args);
+    bool prepareSeries(const QueryArgs& args, qint64 defaultLastSec);
+
+    // Each returns false when it yields before the end of the results
+    bool resumeUnits();
+    bool resumeSamples();
+    bool resumeRollup();
+
+    bool resolveSeries(const QueryArgs& args, UnitID* unitID, quint16* sensorIndex);
+    bool timeRange(const QueryArgs& args, qint64 defaultLastSec, qint64* fromMs, qint64* toMs);
+
+    IoTropolisQuerySession* m_session;
+    QByteArray m_request;
+    const UnitRegistry* m_registry;
+    const SampleStore* m_store;
+    std::shared_ptr<QueryState> m_state;
+
+    QByteArray m_chunk;
+    int m_chunkRows{0};
+    int m_rows{0};
+    bool m_failed{false};
+
+    // Position kept across yields
+    bool m_prepared{false};
+    Kind m_kind{Kind::Units};
+    QVector<UnitRecord> m_units;
+    int m_unitPos{0};
+    UnitID m_unitID{0};
+    quint16 m_sensorIndex{0};
+    qint64 m_resolutionMs{0};
+    qint64 m_fromMs{0};
+    qint64 m_toMs{0};
+    quint64 m_cursor{0};
+};
+
+namespace {
+
+// Pool entry for one run of a task; the session owns the task itself
+class QueryRunnable : public QRunnable
+{
+public:
+    explicit QueryRunnable(std::shared_ptr<QueryTask> task) : m_task(std::move(task)) {}
+    void run() override { m_task->run(); }
+
+private:
+    std::shared_ptr<QueryTask> m_task;
+};
+
+} // namespace
+
+void QueryTask::run()
+{
+    if (!m_prepared) {
+        m_prepared = true;
+        if (!prepare())
+            m_failed = true;
+    }
+
+    bool done = true;
+    if (!m_failed && !cancelled()) {
+        switch (m_kind) {
+        case Kind::Units:   done = resumeUnits();   break;
+        case Kind::Samples: done = resumeSamples(); break;
+        case Kind::Rollup:  done = resumeRollup();  break;
+        }
+    }
+
+    IoTropolisQuerySession* session = m_session;
+    if (!done && !cancelled()) {
+        flush();
+        QMetaObject::invokeMethod(session, [session]() { session->queryPaused(); },
+                                  Qt::QueuedConnection);
+        return;
+    }
+
+    if (!m_failed && !cancelled())
+        m_chunk += "END " + QByteArray::number(m_rows) + "\n";
+    flush();
+
+    QMetaObject::invokeMethod(session, [session]() { session->queryFinished(); },
+                              Qt::QueuedConnection);
+}
+
+bool QueryTask::prepare()
+{
+    const QList<QByteArray> parts = m_request.split(' ');
+    const QByteArray command = parts.value(0).toUpper();
+
+    QueryArgs args;
+    for (int i = 1; i < parts.size(); ++i) {
+        const QByteArray& part = parts.at(i);
+        if (part.isEmpty())
+            continue;
+        const int eq = part.indexOf('=');
+        if (eq <= 0) {
+            fail("Malformed argument " + part);
+            return false;
+        }
+        args.insert(part.left(eq).toLower(), part.mid(eq + 1));
+    }
+
+    if (command == "UNITS")
+        return prepareUnits(args);
+
+    if (command == "SAMPLES") {
+        m_kind = Kind::Samples;
+        return prepareSeries(args, 600);
+    }
+
+    if (command == "ROLLUP") {
+        static const QHash<QByteArray, qint64> resolutions = {
+            {"1s", 1000}, {"1m", 60000}, {"1h", 3600000}
+        };
+
+        m_kind = Kind::Rollup;
+        m_resolutionMs = resolutions.value(args.value("res"), 0);
+        if (m_resolutionMs == 0) {
+            fail("Invalid res (expected 1s, 1m or 1h)");
+            return false;
+        }
+        return prepareSeries(args, 3600);
+    }
+
+    fail("Unknown query " + command);
+    return false;
+}
+
+void QueryTask::row(const QByteArray& line)
+{
+    m_chunk += line;
+    m_chunk += '\n';
+    ++m_rows;
+
+    if (++m_chunkRows >= ChunkRows)
+        flush();
+}
+
+void QueryTask::fail(const QByteArray& reason)
+{
+    m_chunk += "ERROR " + reason + "\n";
+    m_failed = true;
+}
+
+void QueryTask::flush()
+{
+    m_chunkRows = 0;
+    if (m_chunk.isEmpty() || cancelled()) {
+        m_chunk.clear();
+        return;
+    }
+
+    m_state->pendingBytes += m_chunk.size();
+
+    IoTropolisQuerySession* session = m_session;
+    const QByteArray chunk = m_chunk;
+    QMetaObject::invokeMethod(session, [session, chunk]() { session->writeChunk(chunk); },
+                              Qt::QueuedConnection);
+    m_chunk.clear();
+}
+
+bool QueryTask::resolveSeries(const QueryArgs& args, UnitID* unitID, quint16* sensorIndex)
+{
+    bool ok = false;
+    *unitID = args.value("unit").toUInt(&ok);
+    if (!ok) {
+        fail("Missing or invalid unit");
+        return false;
+    }
+
+    // Resolved from the store, not the live registry: history stays
+    // queryable after the unit disconnects
+    if (!m_store->containsUnit(*unitID)) {
+        fail("Unknown unit " + args.value("unit"));
+        return false;
+    }
+
+    const int idx = m_store->sensorIndex(*unitID, QString::fromUtf8(args.value("sensor")));
+    if (idx < 0) {
+        fail("Unknown sensor " + args.value("sensor"));
+        return false;
+    }
+
+    *sensorIndex = quint16(idx);
+    return true;
+}
+
+bool QueryTask::timeRange(const QueryArgs& args, qint64 defaultLastSec,
+                          qint64* fromMs, qint64* toMs)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    bool ok = true;
+
+    *toMs = args.contains("to") ? args.value("to").toLongLong(&ok) : now;
+    if (!ok) {
+        fail("Invalid to");
+        return false;
+    }
+    // Nothing is stored outside this range, and it keeps 'to - last' exact
+    *toMs = qBound<qint64>(0, *toMs, MaxSampleTimestampMs);
+
+    if (args.contains("from")) {
+        *fromMs = args.value("from").toLongLong(&ok);
+    } else {
+        const qint64 last = args.contains("last")
+                                ? args.value("last").toLongLong(&ok)
+                                : defaultLastSec;
+        if (ok && last < 0)
+            ok = false;
+        *fromMs = *toMs - qMin(last, MaxLastSec) * 1000;
+    }
+    if (!ok) {
+        fail("Invalid from/last");
+        return false;
+    }
+    return true;
+}
+
+bool QueryTask::prepareUnits(const QueryArgs& args)
+{
+    m_kind = Kind::Units;
+    m_units = m_registry->unitsMatching(QString::fromUtf8(args.value("type")),
+                                        QString::fromUtf8(args.value("sensor")));
+    return true;
+}
+
+bool QueryTask::prepareSeries(const QueryArgs& args, qint64 defaultLastSec)
+{
+    return resolveSeries(args, &m_unitID, &m_sensorIndex) &&
+           timeRange(args, defaultLastSec, &m_fromMs, &m_toMs);
+}
+
+bool QueryTask::resumeUnits()
+{
+    for (; m_unitPos < m_units.size(); ++m_unitPos) {
+        if (cancelled())
+            return true;
+        if (m_chunkRows == 0 && congested())
+            return false;
+
+        const UnitRecord& u = m_units.at(m_unitPos);
+
+        QStringList sensors, actuators;
+        for (const auto& s : u.sensors)
+            sensors << s.name();
+        for (const auto& a : u.actuators)
+            actuators << a.name();
+
+        row("UNIT " + QByteArray::number(u.unitID) + ' ' +
+            u.ipAddress.toUtf8() + ' ' +
+            u.unitType.toUtf8() + ' ' +
+            u.unitSubtype.toUtf8() + ' ' +
+            sensors.join(',').toUtf8() + ' ' +
+            actuators.join(',').toUtf8());
+    }
+    return true;
+}
+
+bool QueryTask::resumeSamples()
+{
+    QVector<SampleStore::RawPoint> points;
+    while (!cancelled()) {
+        if (congested())
+            return false;
+
+        points.clear();
+        m_cursor = m_store->readRaw(m_unitID, m_sensorIndex, m_fromMs, m_toMs,
+                                    m_cursor, ChunkRows, &points);
+        if (points.isEmpty())
+            break;
+
+        for (const auto& p : points)
+            row("S " + QByteArray::number(p.timestampMs) + ' ' +
+                QByteArray::number(p.value, 'g', 12));
+    }
+    return true;
+}
+
+bool QueryTask::resumeRollup()
+{
+    QVector<ClosedWindow> windows;
+    while (!cancelled()) {
+        if (congested())
+            return false;
+
+        windows.clear();
+        m_cursor = m_store->readWindows(m_unitID, m_sensorIndex, m_resolutionMs,
+                                        m_fromMs, m_toMs, m_cursor, ChunkRows, &windows);
+        if (windows.isEmpty())
+            break;
+
+        for (const auto& w : windows)
+            row("W " + QByteArray::number(w.startMs) + ' ' +
+                QByteArray::number(w.count) + ' ' +
+                QByteArray::number(w.min, 'g', 12) + ' ' +
+                QByteArray::number(w.max, 'g', 12) + ' ' +
+                QByteArray::number(w.mean, 'g', 12));
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// SESSION
+// ------------------------------------------------------------
+IoTropolisQuerySession::IoTropolisQuerySession(QLocalSocket* socket,
+                                               const UnitRegistry* registry,
+                                               const SampleStore* store,
+                                               QThreadPool* pool,
+                                               const QueryControlCommands* controls,
+                                               QObject* parent)
+    : QObject(parent)
+    , m_socket(socket)
+    , m_registry(registry)
+    , m_store(store)
+    , m_pool(pool)
+    , m_controls(controls)
+    , m_state(std::make_shared<QueryState>())
+{
+    m_socket->setParent(this);
+
+    connect(m_socket, &QLocalSocket::readyRead,
+            this, &IoTropolisQuerySession::onReadyRead);
+    connect(m_socket, &QLocalSocket::bytesWritten,
+            this, &IoTropolisQuerySession::onBytesWritten);
+    connect(m_socket, &QLocalSocket::disconnected,
+            this, &IoTropolisQuerySession::onDisconnected);
+}
+
+void IoTropolisQuerySession::onReadyRead()
+{
+    while (m_socket->canReadLine()) {
+        QByteArray line = m_socket->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        // Requests are answered one at a time; a client pipelining far
+        // ahead of its answers would queue without bound
+        if (m_requests.size() >= MaxQueuedRequests) {
+            qWarning() << "[IoTropolisQuery] Too many queued requests, closing session";
+            m_socket->write("ERROR Too many queued requests\n");
+            m_socket->disconnectFromServer();
+            return;
+        }
+        m_requests.enqueue(line);
+    }
+
+    if (m_socket->bytesAvailable() > MaxRequestLength) {
+        qWarning() << "[IoTropolisQuery] Request too long, closing session";
+        m_socket->write("ERROR Request too long\n");
+        m_socket->disconnectFromServer();
+        return;
+    }
+
+    startNext();
+}
+
+void IoTropolisQuerySession::startNext()
+{
+    while (!m_busy && !m_closing && !m_requests.isEmpty()) {
+        const QByteArray request = m_requests.dequeue();
+
+        const int space = request.indexOf(' ');
+        const QByteArray command = (space < 0 ? request : request.left(space)).toUpper();
+
+        // Control commands touch server state; answer them on this thread
+        auto it = m_controls->constFind(command);
+        if (it != m_controls->constEnd()) {
+            const QByteArray response =
+                it.value()(space < 0 ? QByteArray() : request.mid(space + 1));
+            m_state->pendingBytes += response.size();
+            m_socket->write(response);
+            continue;
+        }
+
+        m_busy = true;
+        m_task = std::make_shared<QueryTask>(this, request, m_registry, m_store, m_state);
+        m_pool->start(new QueryRunnable(m_task));
+    }
+}
+
+void IoTropolisQuerySession::writeChunk(const QByteArray& chunk)
+{
+    if (m_closing || m_socket->state() != QLocalSocket::ConnectedState) {
+        m_state->pendingBytes -= chunk.size();
+        return;
+    }
+    m_socket->write(chunk);
+}
+
+void IoTropolisQuerySession::onBytesWritten(qint64 bytes)
+{
+    m_state->pendingBytes -= bytes;
+
+    // Resume once half the buffer has drained, not on every write
+    if (m_paused && m_state->pendingBytes.load() <= MaxBufferedBytes / 2)
+        resumeTask();
+}
+
+void IoTropolisQuerySession::resumeTask()
+{
+    m_paused = false;
+    m_pool->start(new QueryRunnable(m_task));
+}
+
+void IoTropolisQuerySession::queryPaused()
+{
+    if (m_closing) {
+        queryFinished();
+        return;
+    }
+
+    m_paused = true;
+    if (m_state->pendingBytes.load() <= MaxBufferedBytes / 2)
+        resumeTask();
+}
+
+void IoTropolisQuerySession::queryFinished()
+{
+    m_busy = false;
+    m_paused = false;
+    m_task.reset();
+
+    if (m_closing)
+        deleteLater();
+    else
+        startNext();
+}
+
+void IoTropolisQuerySession::cancel()
+{
+    m_state->cancelled = true;
+}
+
+void IoTropolisQuerySession::onDisconnected()
+{
+    m_closing = true;
+    cancel();
+
+    // A running task still posts to this session; wait for it to finish.
+    // A paused one is not running and is simply dropped.
+    if (!m_busy || m_paused)
+        deleteLater();
+}
+
+// ------------------------------------------------------------
+// SERVER
+// ------------------------------------------------------------
+IoTropolisQueryServer::IoTropolisQueryServer(const UnitRegistry* registry,
+                                             const SampleStore* store,
+                                             QObject* parent)
+    : QObject(parent)
+    , m_registry(registry)
+    , m_store(store)
+{
+}
+
+IoTropolisQueryServer::~IoTropolisQueryServer()
+{
+    for (auto* session : m_sessions)
+        session->cancel();
+    m_pool.waitForDone();
+}
+
+void IoTropolisQueryServer::setWorkerCount(int workerThreads)
+{
+    m_pool.setMaxThreadCount(qMax(1, workerThreads));
+}
+
+void IoTropolisQueryServer::addControlCommand(const QByteArray& name, QueryControlHandler handler)
+{
+    m_controls.insert(name.toUpper(), std::move(handler));
+}
+
+bool IoTropolisQueryServer::start(const QString& socketName, int workerThreads)
+{
+    setWorkerCount(workerThreads);
+
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection,
+            this, &IoTropolisQueryServer::onNewConnection);
+
+    bool listening = m_server->listen(socketName);
+
+    // The name is taken: only a socket nobody answers on, left behind by a
+    // crashed instance, may be removed. A live instance keeps its socket.
+    if (!listening && m_server->serverError() == QAbstractSocket::AddressInUseError) {
+        QLocalSocket probe;
+        probe.connectToServer(socketName);
+        if (probe.waitForConnected(StaleProbeTimeoutMs)) {
+            probe.disconnectFromServer();
+            qCritical() << "[IoTropolisQuery] Another instance is serving" << socketName;
+            return false;
+        }
+
+        qWarning() << "[IoTropolisQuery] Removing stale socket" << socketName;
+        QLocalServer::removeServer(socketName);
+        listening = m_server->listen(socketName);
+    }
+
+    if (!listening) {
+        qCritical() << "[IoTropolisQuery] Failed to listen on" << socketName
+                    << ":" << m_server->errorString();
+        return false;
+    }
+
+    qDebug() << "[IoTropolisQuery] Query endpoint listening on"
+             << m_server->fullServerName();
+    return true;
+}
+
+void IoTropolisQueryServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket* socket = m_server->nextPendingConnection();
+        auto* session = new IoTropolisQuerySession(socket, m_registry, m_store,
+                                                   &m_pool, &m_controls, this);
+        m_sessions.insert(session);
+
+        connect(session, &QObject::destroyed,
+                this, [this, session]() { m_sessions.remove(session); });
+    }
+}
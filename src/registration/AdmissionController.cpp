@@ -0,0 +1,92 @@
+#include "registration/AdmissionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr qint64 PruneIntervalMs = 60000;
+constexpr qint64 MaxRetryAfterMs = 300000;
+
+} // namespace
+
+AdmissionController::AdmissionController(const AdmissionSettings& settings)
+    : m_settings(settings)
+{
+    m_global.tokens = m_settings.globalBurst;
+}
+
+void AdmissionController::setSettings(const AdmissionSettings& settings)
+{
+    m_settings = settings;
+    m_global.tokens = std::min(m_global.tokens, m_settings.globalBurst);
+}
+
+void AdmissionController::refill(Bucket& b, double rate, double burst, qint64 nowMs)
+{
+    if (nowMs > b.lastMs)
+        b.tokens = std::min(burst, b.tokens + rate * double(nowMs - b.lastMs) / 1000.0);
+    b.lastMs = nowMs;
+}
+
+int AdmissionController::waitMs(const Bucket& b, double rate)
+{
+    if (rate <= 0.0)
+        return 60000;
+    return int(std::ceil((1.0 - b.tokens) / rate * 1000.0));
+}
+
+bool AdmissionController::admit(const QString& ip, qint64 nowMs, int* retryAfterMs)
+{
+    pruneIdle(nowMs);
+
+    auto it = m_perIp.find(ip);
+    if (it == m_perIp.end()) {
+        Bucket fresh;
+        fresh.tokens = m_settings.perIpBurst;
+        fresh.lastMs = nowMs;
+        it = m_perIp.insert(ip, fresh);
+    }
+
+    Bucket& perIp = it.value();
+    refill(perIp, m_settings.perIpRate, m_settings.perIpBurst, nowMs);
+    refill(m_global, m_settings.globalRate, m_settings.globalBurst, nowMs);
+
+    if (perIp.tokens < 1.0) {
+        *retryAfterMs = waitMs(perIp, m_settings.perIpRate);
+        ++m_rejected;
+        return false;
+    }
+    if (m_global.tokens < 1.0) {
+        // Hand out consecutive future slots instead of one common wait
+        // time, so a rejected herd comes back as a ramp at globalRate
+        const qint64 earliest = nowMs + waitMs(m_global, m_settings.globalRate);
+        const qint64 slot = std::max(m_nextGlobalSlotMs, earliest);
+        if (m_settings.globalRate > 0.0)
+            m_nextGlobalSlotMs = slot + qint64(std::ceil(1000.0 / m_settings.globalRate));
+
+        *retryAfterMs = int(std::min(slot - nowMs, MaxRetryAfterMs));
+        ++m_rejected;
+        return false;
+    }
+
+    perIp.tokens -= 1.0;
+    m_global.tokens -= 1.0;
+    return true;
+}
+
+void AdmissionController::pruneIdle(qint64 nowMs)
+{
+    if (nowMs - m_lastPruneMs < PruneIntervalMs)
+        return;
+    m_lastPruneMs = nowMs;
+
+    // A bucket that has refilled completely carries no state
+    for (auto it = m_perIp.begin(); it != m_perIp.end(); ) {
+        refill(it.value(), m_settings.perIpRate, m_settings.perIpBurst, nowMs);
+        if (it->tokens >= m_settings.perIpBurst)
+            it = m_perIp.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,566 @@
+#include "registration/HandshakeParser.h"
+
+#include <QHash>
+
+#include <cstring>
+
+namespace {
+
+constexpr int MaxInternLength = 64;
+constexpr int MaxInterned     = 16384;
+
+// Unit connections are handled on the server thread; a table per thread
+// needs no locking. Bounded, so units sending unique names cannot grow it
+// without limit.
+QString intern(const char* data, int length)
+{
+    thread_local QHash<QByteArray, QString> table;
+
+    // Raw-data key: no allocation on a hit
+    auto it = table.constFind(QByteArray::fromRawData(data, length));
+    if (it != table.constEnd())
+        return it.value();
+
+    const QString s = QString::fromUtf8(data, length);
+    if (length <= MaxInternLength && table.size() < MaxInterned)
+        table.insert(QByteArray(data, length), s);
+    return s;
+}
+
+bool parseHex4(const char*& p, const char* end, uint* out)
+{
+    if (end - p < 4)
+        return false;
+
+    uint v = 0;
+    for (int i = 0; i < 4; ++i, ++p) {
+        const char c = *p;
+        v <<= 4;
+        if (c >= '0' && c <= '9')      v |= uint(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= uint(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= uint(c - 'A' + 10);
+        else return false;
+    }
+    *out = v;
+    return true;
+}
+
+void appendUtf8(std::vector<char>& out, uint cp)
+{
+    if (cp < 0x80) {
+        out.push_back(char(cp));
+    } else if (cp < 0x800) {
+        out.push_back(char(0xC0 | (cp >> 6)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(char(0xE0 | (cp >> 12)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(char(0xF0 | (cp >> 18)));
+        out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Length of the well-formed UTF-8 sequence at p, 0 if there is none.
+// Overlong forms, surrogates and code points above U+10FFFF are rejected,
+// as QJsonDocument rejects them.
+int utf8Length(const char* p, const char* end)
+{
+    const uchar c = uchar(*p);
+    if (c < 0x80)
+        return 1;
+
+    int n;
+    uint cp, min;
+    if (c >= 0xC2 && c <= 0xDF)      { n = 2; cp = c & 0x1F; min = 0x80; }
+    else if ((c & 0xF0) == 0xE0)     { n = 3; cp = c & 0x0F; min = 0x800; }
+    else if (c >= 0xF0 && c <= 0xF4) { n = 4; cp = c & 0x07; min = 0x10000; }
+    else return 0;
+
+    if (end - p < n)
+        return 0;
+    for (int i = 1; i < n; ++i) {
+        const uchar cc = uchar(p[i]);
+        if ((cc & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000))
+        return 0;
+    return n;
+}
+
+// UTF-8 that may also encode lone surrogates (as appendUtf8 writes them)
+QString fromWtf8(const char* p, int length)
+{
+    QString out;
+    out.reserve(length);
+
+    const char* end = p + length;
+    while (p < end) {
+        const uchar c = uchar(*p);
+        int n;
+        uint cp;
+        if (c < 0x80)      { n = 1; cp = c; }
+        else if (c < 0xE0) { n = 2; cp = c & 0x1F; }
+        else if (c < 0xF0) { n = 3; cp = c & 0x0F; }
+        else               { n = 4; cp = c & 0x07; }
+        for (int i = 1; i < n; ++i)
+            cp = (cp << 6) | (uchar(p[i]) & 0x3F);
+        p += n;
+
+        if (QChar::requiresSurrogates(cp)) {
+            out.append(QChar(QChar::highSurrogate(cp)));
+            out.append(QChar(QChar::lowSurrogate(cp)));
+        } else {
+            out.append(QChar(ushort(cp)));
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+// ------------------------------------------------------------
+// PAYLOADS
+// ------------------------------------------------------------
+bool HandshakeParser::parseHello(const QByteArray& data, QString* identity, QString* secret)
+{
+    begin(data);
+
+    Text version, id, secretText;
+    if (!consume('{'))
+        return false;
+
+    if (!consume('}')) {
+        do {
+            Text key;
+            if (!parseString(&key) || !consume(':'))
+                return false;
+
+            bool ok;
+            if (textEquals(key, "version", 7))
+                ok = parseValueText(&version, 1);
+            else if (textEquals(key, "identity", 8))
+                ok = parseValueText(&id, 1);
+            else if (textEquals(key, "secret", 6))
+                ok = parseValueText(&secretText, 1);
+            else
+                ok = skipValue(1);
+            if (!ok)
+                return false;
+        } while (consume(','));
+
+        if (!consume('}'))
+            return false;
+    }
+
+    if (!atEnd() || !version.isString || !textEquals(version, "1.0", 3))
+        return false;
+
+    // Identities and secrets are unique per unit; not worth interning
+    *identity = id.isString ? textString(id) : QString();
+    *secret = secretText.isString ? textString(secretText) : QString();
+    return true;
+}
+
+HandshakeParser::Result HandshakeParser::parseDescribe(const QByteArray& data,
+                                                       QString* unitType, QString* unitSubtype,
+                                                       QList<IOComponent>* sensors,
+                                                       QList<IOComponent>* actuators)
+{
+    begin(data);
+
+    Text type, subtype;
+    bool sensorsValid = true;
+    bool actuatorsValid = true;
+    sensors->clear();
+    actuators->clear();
+
+    bool wellFormed = consume('{');
+    if (wellFormed && !consume('}')) {
+        do {
+            Text key;
+            if (!parseString(&key) || !consume(':')) {
+                wellFormed = false;
+                break;
+            }
+
+            bool ok;
+            if (textEquals(key, "type", 4))
+                ok = parseValueText(&type, 1);
+            else if (textEquals(key, "subtype", 7))
+                ok = parseValueText(&subtype, 1);
+            else if (textEquals(key, "sensors", 7))
+                ok = parseComponents(sensors, &sensorsValid, 1);
+            else if (textEquals(key, "actuators", 9))
+                ok = parseComponents(actuators, &actuatorsValid, 1);
+            else
+                ok = skipValue(1);
+
+            if (!ok) {
+                wellFormed = false;
+                break;
+            }
+        } while (consume(','));
+
+        wellFormed = wellFormed && consume('}');
+    }
+    wellFormed = wellFormed && atEnd();
+
+    if (!wellFormed) {
+        unitType->clear();
+        unitSubtype->clear();
+        sensors->clear();
+        actuators->clear();
+        return Result::Ok;
+    }
+
+    *unitType    = type.isString ? internText(type) : QString();
+    *unitSubtype = subtype.isString ? internText(subtype) : QString();
+
+    if (!sensorsValid)
+        return Result::InvalidSensor;
+    if (!actuatorsValid)
+        return Result::InvalidActuator;
+    return Result::Ok;
+}
+
+void HandshakeParser::release()
+{
+    std::vector<char>().swap(m_arena);
+}
+
+// Components are appended as they are read; a later duplicate key
+// replaces the whole list
+bool HandshakeParser::parseComponents(QList<IOComponent>* list, bool* valid, int depth)
+{
+    list->clear();
+    *valid = true;
+
+    // Anything but an array reads as no components
+    if (!peek('['))
+        return skipValue(depth);
+    ++m_p;
+
+    if (consume(']'))
+        return true;
+
+    do {
+        if (!parseComponent(list, valid, depth + 1))
+            return false;
+    } while (consume(','));
+
+    return consume(']');
+}
+
+bool HandshakeParser::parseComponent(QList<IOComponent>* list, bool* valid, int depth)
+{
+    if (!peek('{')) {
+        *valid = false;
+        return skipValue(depth);
+    }
+    ++m_p;
+
+    Text name, format;
+    if (!consume('}')) {
+        do {
+            Text key;
+            if (!parseString(&key) || !consume(':'))
+                return false;
+
+            bool ok;
+            if (textEquals(key, "name", 4))
+                ok = parseValueText(&name, depth + 1);
+            else if (textEquals(key, "format", 6))
+                ok = parseValueText(&format, depth + 1);
+            else
+                ok = skipValue(depth + 1);
+            if (!ok)
+                return false;
+        } while (consume(','));
+
+        if (!consume('}'))
+            return false;
+    }
+
+    if (!name.isString || !format.isString || name.length == 0 || format.length == 0)
+        *valid = false;
+    else if (*valid)
+        list->append(IOComponent(internText(name), internText(format)));
+
+    return true;
+}
+
+// ------------------------------------------------------------
+// TOKENS
+// ------------------------------------------------------------
+void HandshakeParser::begin(const QByteArray& data)
+{
+    m_begin = m_p = data.constData();
+    m_end = m_begin + data.size();
+    m_arena.clear();
+
+    // QJsonDocument skips a UTF-8 byte order mark
+    if (m_end - m_p >= 3 && std::memcmp(m_p, "\xEF\xBB\xBF", 3) == 0)
+        m_p += 3;
+}
+
+bool HandshakeParser::atEnd()
+{
+    skipWs();
+    return m_p == m_end;
+}
+
+void HandshakeParser::skipWs()
+{
+    while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+        ++m_p;
+}
+
+bool HandshakeParser::peek(char c)
+{
+    skipWs();
+    return m_p < m_end && *m_p == c;
+}
+
+bool HandshakeParser::consume(char c)
+{
+    if (!peek(c))
+        return false;
+    ++m_p;
+    return true;
+}
+
+bool HandshakeParser::parseString(Text* out)
+{
+    if (!consume('"'))
+        return false;
+
+    // Common case: no escapes, reference the input directly
+    const char* start = m_p;
+    while (m_p < m_end && *m_p != '"' && *m_p != '\\') {
+        const int n = utf8Length(m_p, m_end);
+        if (n == 0)
+            return false;
+        m_p += n;
+    }
+    if (m_p >= m_end)
+        return false;
+
+    out->isString = true;
+    out->hasSurrogates = false;
+    if (*m_p == '"') {
+        out->inArena = false;
+        out->offset = int(start - m_begin);
+        out->length = int(m_p - start);
+        ++m_p;
+        return true;
+    }
+
+    // Escaped: decode into the arena, starting with the plain prefix
+    out->inArena = true;
+    out->offset = int(m_arena.size());
+    m_arena.insert(m_arena.end(), start, m_p);
+
+    while (m_p < m_end && *m_p != '"') {
+        if (*m_p != '\\') {
+            const int n = utf8Length(m_p, m_end);
+            if (n == 0)
+                return false;
+            m_arena.insert(m_arena.end(), m_p, m_p + n);
+            m_p += n;
+            continue;
+        }
+
+        if (++m_p >= m_end)
+            return false;
+
+        const char escaped = *m_p++;
+        switch (escaped) {
+        case '"':  m_arena.push_back('"');  break;
+        case '\\': m_arena.push_back('\\'); break;
+        case '/':  m_arena.push_back('/');  break;
+        case 'b':  m_arena.push_back('\b'); break;
+        case 'f':  m_arena.push_back('\f'); break;
+        case 'n':  m_arena.push_back('\n'); break;
+        case 'r':  m_arena.push_back('\r'); break;
+        case 't':  m_arena.push_back('\t'); break;
+        case 'u': {
+            uint cp;
+            if (!parseHex4(m_p, m_end, &cp))
+                return false;
+
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                // Combine with a following low surrogate if there is one
+                const char* save = m_p;
+                uint low;
+                if (m_end - m_p >= 6 && m_p[0] == '\\' && m_p[1] == 'u' &&
+                    (m_p += 2, parseHex4(m_p, m_end, &low)) &&
+                    low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                } else {
+                    m_p = save;
+                    out->hasSurrogates = true;
+                }
+            } else if (cp >= 0xDC00 && cp < 0xE000) {
+                out->hasSurrogates = true;
+            }
+            appendUtf8(m_arena, cp);
+            break;
+        }
+        default:
+            // QJsonDocument takes any other escaped byte as that character
+            appendUtf8(m_arena, uchar(escaped));
+            break;
+        }
+    }
+    if (m_p >= m_end)
+        return false;
+
+    ++m_p;
+    out->length = int(m_arena.size()) - out->offset;
+    return true;
+}
+
+bool HandshakeParser::parseValueText(Text* out, int depth)
+{
+    *out = Text();
+    if (peek('"'))
+        return parseString(out);
+    return skipValue(depth);
+}
+
+bool HandshakeParser::skipValue(int depth)
+{
+    skipWs();
+    if (m_p >= m_end)
+        return false;
+
+    switch (*m_p) {
+    case '"': {
+        Text ignored;
+        return parseString(&ignored);
+    }
+    case '{':
+        // A container here is nested depth + 1 deep
+        if (depth >= MaxDepth)
+            return false;
+        ++m_p;
+        if (consume('}'))
+            return true;
+        do {
+            Text key;
+            if (!parseString(&key) || !consume(':') || !skipValue(depth + 1))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    case '[':
+        if (depth >= MaxDepth)
+            return false;
+        ++m_p;
+        if (consume(']'))
+            return true;
+        do {
+            if (!skipValue(depth + 1))
+                return false;
+        } while (consume(','));
+        return consume(']');
+    case 't':
+        return skipLiteral("true", 4);
+    case 'f':
+        return skipLiteral("false", 5);
+    case 'n':
+        return skipLiteral("null", 4);
+    default:
+        return skipNumber();
+    }
+}
+
+// Same scan as QJsonDocument, which then leaves it to QByteArray to decide
+// whether the text is a number (it takes "1." and "-.5", for instance)
+bool HandshakeParser::skipNumber()
+{
+    const char* p = m_p;
+
+    if (p < m_end && *p == '-')
+        ++p;
+
+    if (p < m_end && *p == '0') {
+        ++p;
+    } else {
+        while (p < m_end && isDigit(*p))
+            ++p;
+    }
+
+    if (p < m_end && *p == '.') {
+        ++p;
+        while (p < m_end && isDigit(*p))
+            ++p;
+    }
+
+    if (p < m_end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < m_end && (*p == '+' || *p == '-'))
+            ++p;
+        while (p < m_end && isDigit(*p))
+            ++p;
+    }
+
+    // A number can never end the payload
+    if (p >= m_end)
+        return false;
+
+    const QByteArray number = QByteArray::fromRawData(m_p, int(p - m_p));
+    bool ok = false;
+    number.toLongLong(&ok);
+    if (!ok)
+        number.toDouble(&ok);
+    if (!ok)
+        return false;
+
+    m_p = p;
+    return true;
+}
+
+bool HandshakeParser::skipLiteral(const char* literal, int length)
+{
+    if (m_end - m_p < length || std::memcmp(m_p, literal, size_t(length)) != 0)
+        return false;
+    m_p += length;
+    return true;
+}
+
+// ------------------------------------------------------------
+// TEXT
+// ------------------------------------------------------------
+const char* HandshakeParser::textData(const Text& t) const
+{
+    return t.inArena ? m_arena.data() + t.offset : m_begin + t.offset;
+}
+
+bool HandshakeParser::textEquals(const Text& t, const char* literal, int length) const
+{
+    return t.isString && t.length == length &&
+           std::memcmp(textData(t), literal, size_t(length)) == 0;
+}
+
+QString HandshakeParser::textString(const Text& t) const
+{
+    return t.hasSurrogates ? fromWtf8(textData(t), t.length)
+                           : QString::fromUtf8(textData(t), t.length);
+}
+
+QString HandshakeParser::internText(const Text& t) const
+{
+    // Rare enough not to intern
+    if (t.hasSurrogates)
+        return fromWtf8(textData(t), t.length);
+    return intern(textData(t), t.length);
+}
@@ -21,3 +21,22 @@ QJsonObject IOComponent::toJson() const
     obj["format"] = m_format;
     return obj;
 }
+
+IOComponent::ValueKind IOComponent::valueKindForFormat(const QString& format)
+{
+    const QString f = format.trimmed().toLower();
+
+    if (f == "bool" || f == "boolean")
+        return ValueKind::Bool;
+
+    if (f == "int" || f == "integer" || f == "uint" ||
+        f == "int8" || f == "int16" || f == "int32" || f == "int64" ||
+        f == "uint8" || f == "uint16" || f == "uint32" || f == "uint64")
+        return ValueKind::Integer;
+
+    if (f == "float" || f == "double" || f == "real" || f == "number" ||
+        f == "float32" || f == "float64")
+        return ValueKind::Real;
+
+    return ValueKind::Unknown;
+}
@@ -3,78 +3,175 @@
 #include "registration/IOComponent.h"
 
 #include <QTcpSocket>
-#include <QFile>
-#include <QDir>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
+#include <QHostAddress>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
 #include <QDebug>
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 namespace {
 
-QList<IOComponent> componentsFromJson(const QJsonArray& array)
+UnitRecord recordFor(const IoTropolisUnitConnection* unit)
 {
-    QList<IOComponent> out;
-    for (const auto& v : array) {
-        if (v.isObject())
-            out.append(IOComponent::fromJson(v.toObject()));
-    }
-    return out;
+    UnitRecord r;
+    r.unitID      = unit->unitID();
+    r.identity    = unit->identity();
+    r.ipAddress   = unit->ipAddress();
+    r.unitType    = unit->unitType();
+    r.unitSubtype = unit->unitSubtype();
+    r.sensors     = unit->sensors();
+    r.actuators   = unit->actuators();
+    return r;
 }
 
-QStringList validateComponents(const QList<IOComponent>& expected,
-                               const QList<IOComponent>& actual)
+// 128 random bits, hex encoded
+QString newIdentitySecret()
 {
-    QStringList missing;
+    quint32 words[4];
+    QRandomGenerator::system()->fillRange(words);
+    return QString::fromLatin1(
+        QByteArray(reinterpret_cast<const char*>(words), sizeof(words)).toHex());
+}
 
-    for (const auto& e : expected) {
-        bool found = false;
-        for (const auto& a : actual) {
-            if (a.name() == e.name() &&
-                a.format() == e.format()) {
-                found = true;
-                break;
-            }
-        }
-        if (!found)
-            missing << e.name();
-    }
-    return missing;
+QByteArray secretHash(const QString& secret)
+{
+    return QCryptographicHash::hash(secret.toUtf8(), QCryptographicHash::Sha256);
 }
 
-QJsonArray componentsToJson(const QList<IOComponent>& comps)
+// Compare without an early exit, so timing does not reveal the prefix
+bool sameHash(const QByteArray& a, const QByteArray& b)
 {
-    QJsonArray arr;
-    for (const auto& c : comps)
-        arr.append(c.toJson());
-    return arr;
+    if (a.size() != b.size())
+        return false;
+    char diff = 0;
+    for (int i = 0; i < a.size(); ++i)
+        diff |= char(a.at(i) ^ b.at(i));
+    return diff == 0;
 }
 
 } // namespace
 
 IoTropolisRegistrationServer::IoTropolisRegistrationServer(const QString& unitTypeDir, QObject* parent)
     : QObject(parent)
-    , m_unitTypeDir(unitTypeDir)
+    , m_typeCatalog(unitTypeDir)
 {
-    QDir dir;
-    if (!dir.exists(m_unitTypeDir))
-        dir.mkpath(m_unitTypeDir);
-
     m_units.clear();
-    m_nextUnitID = 1;
+
+    qRegisterMetaType<SensorSampleBatch>("SensorSampleBatch");
+    qRegisterMetaType<ClosedWindowBatch>("ClosedWindowBatch");
+
+    // Closed rollups go to storage; other subscribers connect to aggregator()
+    connect(&m_aggregator, &SensorAggregator::windowsClosed,
+            this, &IoTropolisRegistrationServer::onWindowsClosed);
+
+    // Close windows of series that stopped reporting
+    m_flushTimer.setInterval(1000);
+    connect(&m_flushTimer, &QTimer::timeout,
+            this, &IoTropolisRegistrationServer::onFlushTimer);
+
+    // Armed for the soonest handshake deadline
+    m_clock.start();
+    m_deadlineTimer.setSingleShot(true);
+    connect(&m_deadlineTimer, &QTimer::timeout,
+            this, &IoTropolisRegistrationServer::onDeadlineTimer);
+}
+
+IoTropolisRegistrationServer::~IoTropolisRegistrationServer()
+{
+    // Receive threads read m_udpSessions, which dies before child objects
+    if (m_udp)
+        m_udp->stop();
+
+    // Child transports report their close while ~QObject runs, after this
+    // object is gone as an observer
+    const auto units = findChildren<IoTropolisUnitConnection*>(QString(), Qt::FindDirectChildrenOnly);
+    for (IoTropolisUnitConnection* unit : units)
+        unit->setObserver(nullptr);
+}
+
+void IoTropolisRegistrationServer::setAdmissionSettings(const AdmissionSettings& settings)
+{
+    const int previousBacklog = m_admission.settings().acceptBacklog;
+    m_admission.setSettings(settings);
+    if (settings.acceptBacklog != previousBacklog) {
+        if (m_server)
+            m_server->setMaxPendingConnections(settings.acceptBacklog);
+        if (m_epoll)
+            m_epoll->setBacklog(settings.acceptBacklog);
+    }
+    updateAcceptState();
+}
+
+void IoTropolisRegistrationServer::setSampleHistory(int rawPerSensor, int windowsPerResolution)
+{
+    m_store.setCapacity(rawPerSensor, windowsPerResolution);
+}
+
+void IoTropolisRegistrationServer::setSampleRetention(int retentionSec, int maxRetainedUnits)
+{
+    m_store.setRetention(qint64(retentionSec) * 1000, maxRetainedUnits);
+}
+
+bool IoTropolisRegistrationServer::startUdpIngest(const QString& bindAddress,
+                                                  quint16 port, int threads)
+{
+    m_udp = new UdpIngestListener(&m_udpSessions, this);
+    connect(m_udp, &UdpIngestListener::samplesReceived,
+            this, &IoTropolisRegistrationServer::onUdpSamples);
+
+    if (!m_udp->start(bindAddress, port, threads)) {
+        qCritical() << "Failed to start UDP ingest on port" << port;
+        delete m_udp;
+        m_udp = nullptr;
+        return false;
+    }
+
+    return true;
 }
 
-bool IoTropolisRegistrationServer::start(quint16 port)
+bool IoTropolisRegistrationServer::start(const QString& bindAddress, quint16 port,
+                                         Transport transport)
 {
+    if (transport == Transport::Epoll) {
+        m_epoll = new EpollUnitListener(this);
+        connect(m_epoll, &EpollUnitListener::newUnit,
+                this, &IoTropolisRegistrationServer::adoptUnit);
+
+        if (!m_epoll->listen(bindAddress, port, m_admission.settings().acceptBacklog)) {
+            qCritical() << "Failed to start epoll server on port" << port;
+            return false;
+        }
+
+        m_flushTimer.start();
+
+        qDebug() << "[IoTropolis] Server started on port" << port << "(epoll transport)";
+        return true;
+    }
+
     m_server = new QTcpServer(this);
+    m_server->setMaxPendingConnections(m_admission.settings().acceptBacklog);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    // Older Qt passes a fixed backlog of 50 to listen()
+    m_server->setListenBacklogSize(m_admission.settings().acceptBacklog);
+#endif
     connect(m_server, &QTcpServer::newConnection,
             this, &IoTropolisRegistrationServer::onNewConnection);
 
-    if (!m_server->listen(QHostAddress::Any, port)) {
-        qCritical() << "Failed to start server on port" << port;
+    // Same as the epoll backend: "0.0.0.0", "::" or empty is dual-stack
+    QHostAddress address(bindAddress);
+    if (bindAddress.isEmpty() || address == QHostAddress::AnyIPv4 || address == QHostAddress::AnyIPv6)
+        address = QHostAddress::Any;
+    if (address.isNull() || !m_server->listen(address, port)) {
+        qCritical() << "Failed to start server on" << bindAddress << "port" << port;
         return false;
     }
 
+    m_flushTimer.start();
+
     qDebug() << "[IoTropolis] Server started on port" << port;
     return true;
 }
@@ -82,38 +179,110 @@ bool IoTropolisRegistrationServer::start(quint16 port)
 // ---------------------- Handle new connections ----------------------
 void IoTropolisRegistrationServer::onNewConnection()
 {
-    while (m_server->hasPendingConnections())
+    // At the handshake cap the rest stays queued (bounded by the backlog)
+    while (m_server->hasPendingConnections() && !m_admission.atHandshakeCap())
     {
         QTcpSocket* socket = m_server->nextPendingConnection();
-        auto* unit = new IoTropolisUnitConnection(socket, this);
-
-        unit->setUnitID(m_nextUnitID++);
+        adoptUnit(new IoTropolisUnitConnection(socket, this));
+    }
+}
 
-        qDebug() << "[IoTropolis] New connection assigned UnitID"
-                 << unit->unitID()
-                 << "from IP" << unit->ipAddress();
+void IoTropolisRegistrationServer::adoptUnit(IoTropolisUnitConnection* unit)
+{
+    unit->setParent(this);
+    unit->setObserver(this);
+
+    if (m_recorder)
+        unit->setRecorder(m_recorder);
+
+    // Out of tokens: no UnitID, no handshake, only a RETRY_AFTER to HELLO
+    int retryAfterMs = 0;
+    if (!m_admission.admit(unit->ipAddress(), QDateTime::currentMSecsSinceEpoch(),
+                           &retryAfterMs)) {
+        unit->rejectWithRetryAfter(retryAfterMs);
+        setDeadline(unit, DeferredHelloTimeoutMs);
+        return;
+    }
 
-        connect(unit, &IoTropolisUnitConnection::helloCompleted,
-                this, [this, unit]() { onUnitHello(unit); });
+    // Out of UnitIDs: refuse rather than reuse one that may be bound
+    const UnitID unitID = m_registry.allocateUnitID();
+    if (unitID == 0) {
+        setDeadline(unit, DeferredHelloTimeoutMs);
+        unit->closeConnection("UnitID space exhausted", "ERROR: No UnitID available");
+        return;
+    }
 
-        connect(unit, &IoTropolisUnitConnection::describeCompleted,
-                this, [this, unit]() { onUnitDescribe(unit); });
+    m_admission.handshakeStarted();
+    m_handshaking.insert(unit);
+    setDeadline(unit, m_admission.settings().handshakeTimeoutMs);
+    updateAcceptState();
 
-        connect(unit, &IoTropolisUnitConnection::protocolError,
-                this, [this, unit](const QString& msg) {
-                    onUnitProtocolError(unit, msg);
-                });
+    unit->setUnitID(unitID);
 
-        connect(unit, &IoTropolisUnitConnection::disconnected,
-                this, [this, unit]() { onUnitDisconnectedInternal(unit); });
+    qDebug() << "[IoTropolis] New connection assigned UnitID"
+             << unit->unitID()
+             << "from IP" << unit->ipAddress();
 
-        m_units.insert(unit);
-    }
+    m_units.insert(unit);
+    m_unitsByID.insert(unit->unitID(), unit);
 }
 
 // ---------------------- Unit events ----------------------
 void IoTropolisRegistrationServer::onUnitHello(IoTropolisUnitConnection* unit)
 {
+    // A known identity gets its previous UnitID back, but only for the
+    // secret issued when it was first bound. An identity is live at most
+    // once in the cluster: while its UnitID is connected here or to a peer
+    // node, the newcomer is rejected (first writer wins) and may retry
+    // once the other connection is gone.
+    const QString identity = unit->identity();
+    if (!identity.isEmpty()) {
+        const UnitID previous = m_registry.unitIDForIdentity(identity);
+        const QByteArray boundHash = m_registry.identitySecretHash(identity);
+
+        if (previous != 0 && previous != unit->unitID() &&
+            (boundHash.isEmpty() || sameHash(secretHash(unit->identitySecret()), boundHash))) {
+            UnitRecord live;
+            const bool remote = m_registry.find(previous, &live) &&
+                                live.originNode != m_registry.nodeID();
+            if (remote || m_unitsByID.contains(previous)) {
+                qWarning() << "[IoTropolis] Identity" << identity
+                           << "already connected as UnitID" << previous
+                           << "on node" << int(remote ? live.originNode : m_registry.nodeID())
+                           << "; rejecting" << unit->ipAddress();
+                unit->closeConnection("Identity already connected",
+                                      "ERROR: Identity already connected");
+                return;
+            }
+        }
+
+        if (previous == 0) {
+            const QString secret = newIdentitySecret();
+            m_registry.bindIdentity(identity, unit->unitID(), secretHash(secret));
+            unit->issueIdentitySecret(secret);
+        } else if (boundHash.isEmpty()) {
+            // Bound before secrets were issued: the first unit to come back
+            // claims it. Nothing proves this is the original unit.
+            qWarning() << "[IoTropolis] SECURITY: identity" << identity
+                       << "had no secret; binding one to the unit at"
+                       << unit->ipAddress() << "(UnitID" << previous << ")";
+            const QString secret = newIdentitySecret();
+            m_registry.bindIdentity(identity, previous, secretHash(secret));
+            unit->issueIdentitySecret(secret);
+        } else if (!sameHash(secretHash(unit->identitySecret()), boundHash)) {
+            qWarning() << "[IoTropolis] SECURITY: wrong secret for identity" << identity
+                       << "from" << unit->ipAddress() << "; rejecting";
+            unit->closeConnection("Identity secret mismatch", "ERROR: Identity not authenticated");
+            return;
+        }
+
+        if (previous != 0 && previous != unit->unitID()) {
+            m_unitsByID.remove(unit->unitID());
+            unit->setUnitID(previous);
+            m_unitsByID.insert(previous, unit);
+        }
+    }
+
     qDebug() << "[IoTropolis] HELLO completed from UnitID"
              << unit->unitID()
              << "IP:" << unit->ipAddress();
@@ -130,65 +299,32 @@ void IoTropolisRegistrationServer::onUnitDescribe(IoTropolisUnitConnection* unit
              << "sensors =" << unit->sensorNames()
              << "actuators =" << unit->actuatorNames();
 
-    QString filename = QString("%1/%2_%3.json")
-                           .arg(m_unitTypeDir, unit->unitType(), unit->unitSubtype());
-    QFile file(filename);
-
-    bool persistentExists = file.exists();
-
-    if (persistentExists) {
-        if (!file.open(QIODevice::ReadOnly)) {
-            emit unitError(unit, "Cannot open type file for validation");
-            return;
-        }
-
-        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-        file.close();
-
-        if (!doc.isObject()) {
-            emit unitError(unit, "Persistent type file corrupted");
-            return;
-        }
-
-        QJsonObject obj = doc.object();
-
-        QList<IOComponent> pSensors =
-            componentsFromJson(obj.value("sensors").toArray());
-        QList<IOComponent> pActuators =
-            componentsFromJson(obj.value("actuators").toArray());
-
-        QStringList missingSensors =
-            validateComponents(pSensors, unit->sensors());
-        QStringList missingActuators =
-            validateComponents(pActuators, unit->actuators());
-
-        if (!missingSensors.isEmpty() || !missingActuators.isEmpty()) {
-            QString msg = "DESCRIBE validation failed. ";
-            if (!missingSensors.isEmpty())
-                msg += "Missing/mismatched sensors: " +
-                       missingSensors.join(", ") + ". ";
-            if (!missingActuators.isEmpty())
-                msg += "Missing/mismatched actuators: " +
-                       missingActuators.join(", ") + ". ";
-            emit unitError(unit, msg);
-            return;
-        }
-
-    } else {
-        if (!file.open(QIODevice::WriteOnly)) {
-            emit unitError(unit, "Cannot create type file");
-            return;
-        }
+    finishHandshake(unit);
 
-        QJsonObject obj;
-        obj["sensors"]   = componentsToJson(unit->sensors());
-        obj["actuators"] = componentsToJson(unit->actuators());
+    const UnitRecord record = recordFor(unit);
 
-        QJsonDocument doc(obj);
-        file.write(doc.toJson(QJsonDocument::Indented));
-        file.close();
+    QString error;
+    if (m_typeCatalog.validateOrCreate(record, &error) == UnitTypeCatalog::Result::Error) {
+        emit unitError(unit, error);
+        unit->closeConnection("Type rejected: " + error, "ERROR: " + error);
+        return;
+    }
 
-        qDebug() << "[IoTropolis] Created new type file:" << filename;
+    m_registry.insert(record);
+    m_store.describeUnit(unit->unitID(), unit->sensorNames());
+
+    // Issued only now, so a rejected unit never holds a valid token
+    if (m_udp) {
+        quint64 token = 0;
+        while (token == 0)
+            token = QRandomGenerator::system()->generate64();
+        unit->setUdpSession(token, m_udp->port());
+
+        UdpSessionTable::Session session;
+        session.token = token;
+        for (const IOComponent& sensor : record.sensors)
+            session.sensorKinds.append(sensor.valueKind());
+        m_udpSessions.insert(unit->unitID(), session);
     }
 
     emit unitFullyRegistered(unit);
@@ -197,6 +333,9 @@ void IoTropolisRegistrationServer::onUnitDescribe(IoTropolisUnitConnection* unit
 void IoTropolisRegistrationServer::onUnitProtocolError(
     IoTropolisUnitConnection* unit, const QString& msg)
 {
+    if (!m_units.contains(unit))
+        return;
+
     qWarning() << "[IoTropolis] Protocol error from UnitID"
                << unit->unitID()
                << "IP:" << unit->ipAddress()
@@ -205,18 +344,209 @@ void IoTropolisRegistrationServer::onUnitProtocolError(
     emit unitError(unit, msg);
 }
 
-void IoTropolisRegistrationServer::onUnitDisconnectedInternal(
-    IoTropolisUnitConnection* unit)
+void IoTropolisRegistrationServer::onUnitDisconnected(IoTropolisUnitConnection* unit)
 {
+    // Rejected at admission: never registered, only a deadline to clear
+    if (!m_units.contains(unit)) {
+        clearDeadline(unit);
+        unit->deleteLater();
+        return;
+    }
+
     qDebug() << "[IoTropolis] Unit disconnected: UnitID"
              << unit->unitID()
              << "IP:" << unit->ipAddress();
 
+    finishHandshake(unit);
+
     // 🔒 notify observers while the object is still valid
     emit unitAboutToBeRemoved(unit);
 
     m_units.remove(unit);
+    if (m_unitsByID.value(unit->unitID()) == unit)
+        m_unitsByID.remove(unit->unitID());
+    m_registry.remove(unit->unitID());
+    if (unit->udpSessionToken() != 0)
+        m_udpSessions.remove(unit->unitID());
+    m_aggregator.dropUnit(unit->unitID());
+    m_store.releaseUnit(unit->unitID(), QDateTime::currentMSecsSinceEpoch());
     emit unitDisconnected(unit);
 
     unit->deleteLater();
 }
+
+// ---------------------- Admission ----------------------
+void IoTropolisRegistrationServer::finishHandshake(IoTropolisUnitConnection* unit)
+{
+    clearDeadline(unit);
+    if (!m_handshaking.remove(unit))
+        return;
+
+    m_admission.handshakeFinished();
+    updateAcceptState();
+}
+
+void IoTropolisRegistrationServer::updateAcceptState()
+{
+    const bool atCap = m_admission.atHandshakeCap();
+
+    if (m_server) {
+        if (atCap) {
+            m_server->pauseAccepting();
+        } else {
+            m_server->resumeAccepting();
+            // Connections queued while at the cap raise no new signal
+            if (m_server->hasPendingConnections())
+                QMetaObject::invokeMethod(this, &IoTropolisRegistrationServer::onNewConnection,
+                                          Qt::QueuedConnection);
+        }
+    }
+
+    if (m_epoll)
+        m_epoll->setAcceptPaused(atCap);
+}
+
+void IoTropolisRegistrationServer::setDeadline(IoTropolisUnitConnection* unit, int timeoutMs)
+{
+    const qint64 deadline = m_clock.elapsed() + timeoutMs;
+    m_deadlines.insert(deadline, unit);
+    m_deadlineOf.insert(unit, deadline);
+
+    if (!m_deadlineTimer.isActive() || m_deadlines.firstKey() == deadline)
+        m_deadlineTimer.start(timeoutMs);
+}
+
+void IoTropolisRegistrationServer::clearDeadline(IoTropolisUnitConnection* unit)
+{
+    // The timer is left running; an early wakeup just re-arms it
+    auto it = m_deadlineOf.find(unit);
+    if (it == m_deadlineOf.end())
+        return;
+    m_deadlines.remove(it.value(), unit);
+    m_deadlineOf.erase(it);
+}
+
+void IoTropolisRegistrationServer::onDeadlineTimer()
+{
+    const qint64 now = m_clock.elapsed();
+
+    while (!m_deadlines.isEmpty() && m_deadlines.firstKey() <= now) {
+        IoTropolisUnitConnection* unit = m_deadlines.first();
+        clearDeadline(unit);
+
+        if (m_handshaking.contains(unit))
+            unit->closeConnection("Handshake timeout", "ERROR: Handshake timeout");
+        else
+            unit->closeConnection("No HELLO after admission was deferred");
+    }
+
+    if (!m_deadlines.isEmpty())
+        m_deadlineTimer.start(int(m_deadlines.firstKey() - now));
+}
+
+// ---------------------- Memory accounting ----------------------
+void IoTropolisRegistrationServer::collectConnectionMemory(int topN, MemoryReport* report) const
+{
+    using Entry = std::pair<qint64, const IoTropolisUnitConnection*>;
+
+    // There are never more entries than connections
+    topN = qBound(0, topN, int(m_units.size()));
+
+    // Min-heap of the topN heaviest seen so far
+    std::vector<Entry> heaviest;
+    heaviest.reserve(size_t(topN));
+    const auto lighter = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+
+    qint64 total = 0;
+    for (const IoTropolisUnitConnection* unit : m_units) {
+        const qint64 bytes = unit->memoryBytes();
+        total += bytes;
+
+        if (topN <= 0)
+            continue;
+        if (int(heaviest.size()) < topN) {
+            heaviest.emplace_back(bytes, unit);
+            std::push_heap(heaviest.begin(), heaviest.end(), lighter);
+        } else if (bytes > heaviest.front().first) {
+            std::pop_heap(heaviest.begin(), heaviest.end(), lighter);
+            heaviest.back() = {bytes, unit};
+            std::push_heap(heaviest.begin(), heaviest.end(), lighter);
+        }
+    }
+
+    std::sort_heap(heaviest.begin(), heaviest.end(), lighter);
+
+    report->connectionCount = m_units.size();
+    report->connectionBytes = total;
+    report->topConnections.clear();
+    for (const Entry& e : heaviest)
+        report->topConnections.append({e.second->unitID(), e.second->ipAddress(), e.first});
+}
+
+// ---------------------- Sample ingest ----------------------
+void IoTropolisRegistrationServer::onUnitSamples(IoTropolisUnitConnection*,
+                                                  const SensorSampleBatch& samples)
+{
+    ingestSamples(samples);
+}
+
+void IoTropolisRegistrationServer::onUdpSamples(const SensorSampleBatch& samples)
+{
+    // Datagrams still queued when their unit disconnected would recreate
+    // the aggregator slots dropUnit() just freed. A batch may span units;
+    // it is only copied when one of them is gone.
+    const auto live = [this](UnitID unitID) {
+        IoTropolisUnitConnection* unit = m_unitsByID.value(unitID);
+        return unit && unit->handshakeDone();
+    };
+
+    int i = 0;
+    UnitID checked = 0;
+    for (; i < samples.size(); ++i) {
+        if (samples[i].unitID == checked)
+            continue;
+        if (!live(samples[i].unitID))
+            break;
+        checked = samples[i].unitID;
+    }
+    if (i == samples.size()) {
+        ingestSamples(samples);
+        return;
+    }
+
+    SensorSampleBatch kept;
+    kept.reserve(samples.size());
+    kept.append(samples.mid(0, i));
+
+    bool keep = false;
+    checked = 0;
+    for (; i < samples.size(); ++i) {
+        if (samples[i].unitID != checked) {
+            checked = samples[i].unitID;
+            keep = live(checked);
+        }
+        if (keep)
+            kept.append(samples[i]);
+    }
+
+    if (!kept.isEmpty())
+        ingestSamples(kept);
+}
+
+void IoTropolisRegistrationServer::ingestSamples(const SensorSampleBatch& samples)
+{
+    m_store.appendSamples(samples);
+    m_aggregator.ingest(samples);
+}
+
+void IoTropolisRegistrationServer::onWindowsClosed(const ClosedWindowBatch& windows)
+{
+    m_store.appendWindows(windows);
+}
+
+void IoTropolisRegistrationServer::onFlushTimer()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    m_aggregator.flushExpired(now);
+    m_store.expire(now);
+}
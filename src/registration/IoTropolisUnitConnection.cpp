@@ -1,17 +1,83 @@
 #include "registration/IoTropolisUnitConnection.h"
 #include "registration/IOComponent.h"
+#include "capture/SessionRecorder.h"
+#include "metrics/MemoryStats.h"
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QDateTime>
 #include <QDebug>
 
+#include <cmath>
+
+namespace {
+
+// Convert a JSON sample value according to the sensor's declared format
+bool sampleValue(const QJsonValue& v, IOComponent::ValueKind kind, double* out)
+{
+    switch (kind) {
+    case IOComponent::ValueKind::Bool:
+        if (!v.isBool())
+            return false;
+        *out = v.toBool() ? 1.0 : 0.0;
+        return true;
+    case IOComponent::ValueKind::Integer:
+        if (!v.isDouble() || std::trunc(v.toDouble()) != v.toDouble())
+            return false;
+        *out = v.toDouble();
+        return true;
+    case IOComponent::ValueKind::Real:
+        if (!v.isDouble())
+            return false;
+        *out = v.toDouble();
+        return true;
+    case IOComponent::ValueKind::Unknown:
+        break;
+    }
+    return false;
+}
+
+// Sample timestamp in epoch ms; rejects non-numbers, NaN/Inf and anything
+// outside isValidSampleTimestamp() before converting
+bool sampleTimestamp(const QJsonValue& v, qint64* out)
+{
+    if (!v.isDouble())
+        return false;
+
+    const double ms = v.toDouble();
+    if (!std::isfinite(ms) || ms < 0.0 || ms > double(MaxSampleTimestampMs))
+        return false;
+
+    *out = qint64(ms);
+    return true;
+}
+
+// Spacing of a SAMPLE batch in ms: a whole, non-negative number, so
+// timestamps never run backwards
+bool samplePeriod(const QJsonValue& v, qint64* out)
+{
+    if (!v.isDouble())
+        return false;
+
+    const double ms = v.toDouble();
+    if (!std::isfinite(ms) || ms < 0.0 || ms > double(MaxSampleTimestampMs) ||
+        std::trunc(ms) != ms)
+        return false;
+
+    *out = qint64(ms);
+    return true;
+}
+
+} // namespace
+
 // ------------------------------------------------------------
 // STATIC DISPATCH MAP INITIALIZATION
 // To add a new command, simply add a line to this map.
 // ------------------------------------------------------------
 const QMap<QString, IoTropolisUnitConnection::HandlerFunc> IoTropolisUnitConnection::m_dispatchMap = {
     {"HELLO",    &IoTropolisUnitConnection::handleHello},
-    {"DESCRIBE", &IoTropolisUnitConnection::handleDescribe}
+    {"DESCRIBE", &IoTropolisUnitConnection::handleDescribe},
+    {"SAMPLE",   &IoTropolisUnitConnection::handleSample}
 };
 
 IoTropolisUnitConnection::IoTropolisUnitConnection(QTcpSocket* socket, QObject* parent)
@@ -21,53 +87,107 @@ IoTropolisUnitConnection::IoTropolisUnitConnection(QTcpSocket* socket, QObject*
     connect(m_socket, &QTcpSocket::disconnected, this, &IoTropolisUnitConnection::onDisconnected);
 }
 
+IoTropolisUnitConnection::IoTropolisUnitConnection(UnitTransport* transport, QObject* parent)
+    : QObject(parent), m_transport(transport)
+{
+    m_transportAddress = m_transport->peerAddress();
+    if (m_transportAddress.startsWith("::ffff:"))
+        m_transportAddress = m_transportAddress.mid(7);
+}
+
 // ------------------------------------------------------------
 // MAIN DISPATCHER
 // ------------------------------------------------------------
 void IoTropolisUnitConnection::onReadyRead()
 {
-    while (m_socket && m_socket->canReadLine()) {
-        QByteArray line = m_socket->readLine().trimmed();
-        if (line.isEmpty()) continue;
-
-        int spaceIdx = line.indexOf(' ');
-        QString command = (spaceIdx == -1) ? QString(line) : QString(line.left(spaceIdx));
-        QByteArray data = (spaceIdx == -1) ? QByteArray() : line.mid(spaceIdx + 1);
-
-        // Lookup the handler in the map
-        auto it = m_dispatchMap.find(command);
-        if (it != m_dispatchMap.end()) {
-            HandlerFunc handler = it.value();
-            (this->*handler)(data); // Call the member function
-        } else {
-            handleUnknownCommand(command);
-        }
+    while (m_socket && m_socket->canReadLine())
+        processLine(m_socket->readLine());
+}
+
+void IoTropolisUnitConnection::processLine(const QByteArray& rawLine)
+{
+    // Closed by us: whatever is still buffered is not acted on
+    if (m_closed) return;
+
+    QByteArray line = rawLine.trimmed();
+    if (line.isEmpty()) return;
+
+    if (m_recorder)
+        m_recorder->record(CaptureFormat::RecordKind::Inbound, m_captureSession,
+                           CaptureFormat::redactSecrets(line));
+
+    int spaceIdx = line.indexOf(' ');
+    QString command = (spaceIdx == -1) ? QString(line) : QString(line.left(spaceIdx));
+    QByteArray data = (spaceIdx == -1) ? QByteArray() : line.mid(spaceIdx + 1);
+
+    // Lookup the handler in the map
+    auto it = m_dispatchMap.find(command);
+    if (it != m_dispatchMap.end()) {
+        HandlerFunc handler = it.value();
+        (this->*handler)(data); // Call the member function
+    } else {
+        handleUnknownCommand(command);
     }
 }
 
+void IoTropolisUnitConnection::transportClosed()
+{
+    // The transport is gone once this returns
+    m_transport = nullptr;
+    recordClose();
+    if (m_observer)
+        m_observer->onUnitDisconnected(this);
+}
+
 // ------------------------------------------------------------
 // COMMAND HANDLERS
 // ------------------------------------------------------------
 
 void IoTropolisUnitConnection::handleHello(const QByteArray& data)
 {
+    // Deferred at admission: no handshake work, just tell it when to return
+    if (m_retryAfterMs > 0) {
+        sendReply(QString("RETRY_AFTER %1").arg(m_retryAfterMs));
+        closeTransport();
+        return;
+    }
+
     if (m_helloDone) {
         failProtocol("Duplicate HELLO", "ERROR: Already greeted");
         return;
     }
 
-    QJsonObject obj = QJsonDocument::fromJson(data).object();
-    if (obj.value("version").toString() != "1.0") {
+    if (!m_parser.parseHello(data, &m_identity, &m_identitySecret)) {
         failProtocol("Version mismatch", "ERROR: Supported version is 1.0");
         return;
     }
 
     m_helloDone = true;
     resetUnknownCommandCounter();
-    sendReply("HELLO_ACK");
-    emit helloCompleted();
+
+    // The server checks the identity here; it may issue a secret or close us
+    if (m_observer)
+        m_observer->onUnitHello(this);
+    if (m_closed)
+        return;
+
+    if (!m_issuedSecret.isEmpty()) {
+        QJsonObject ack;
+        ack.insert("identity_secret", m_issuedSecret);
+        sendReply("HELLO_ACK " +
+                  QString::fromUtf8(QJsonDocument(ack).toJson(QJsonDocument::Compact)));
+        m_issuedSecret.clear();
+    } else {
+        sendReply("HELLO_ACK");
+    }
 }
 
+// DESCRIBE {"type":...,"subtype":...,"sensors":[...],"actuators":[...]}
+// Accepted: DESCRIBE_ACK, with {"unit_id","session_token","udp_port"} when
+// UDP ingest is on. Rejected by the type catalog (the description conflicts
+// with the stored unit type): "ERROR: <reason>", then the server closes the
+// connection. The unit is not registered and gets no UDP session; it has to
+// reconnect with a description that matches its type.
 void IoTropolisUnitConnection::handleDescribe(const QByteArray& data)
 {
     if (!m_helloDone) {
@@ -75,19 +195,113 @@ void IoTropolisUnitConnection::handleDescribe(const QByteArray& data)
         return;
     }
 
-    QJsonObject obj = QJsonDocument::fromJson(data).object();
-    m_unitType = obj.value("type").toString();
-    m_unitSubtype = obj.value("subtype").toString();
-
-    if (!parseComponents(obj.value("sensors").toArray(), m_sensors, "sensor") ||
-        !parseComponents(obj.value("actuators").toArray(), m_actuators, "actuator")) {
-        return; 
+    switch (m_parser.parseDescribe(data, &m_unitType, &m_unitSubtype, &m_sensors, &m_actuators)) {
+    case HandshakeParser::Result::InvalidSensor:
+        failProtocol("Invalid sensor", "ERROR: JSON Format");
+        return;
+    case HandshakeParser::Result::InvalidActuator:
+        failProtocol("Invalid actuator", "ERROR: JSON Format");
+        return;
+    case HandshakeParser::Result::Ok:
+        break;
     }
 
+    // Handshake done: nothing left for the scratch buffer
+    m_parser.release();
     m_describeDone = true;
     resetUnknownCommandCounter();
-    sendReply("DESCRIBE_ACK");
-    emit describeCompleted();
+
+    // The server validates the type here; only a unit it accepts is given
+    // a UDP session, and a rejected one is closed before any ACK
+    if (m_observer)
+        m_observer->onUnitDescribe(this);
+    if (m_closed)
+        return;
+
+    if (m_udpToken != 0) {
+        // Token as a hex string: JSON numbers lose precision above 2^53
+        QJsonObject ack;
+        ack.insert("unit_id", qint64(m_unitID));
+        ack.insert("session_token", QString::number(m_udpToken, 16));
+        ack.insert("udp_port", int(m_udpPort));
+        sendReply("DESCRIBE_ACK " +
+                  QString::fromUtf8(QJsonDocument(ack).toJson(QJsonDocument::Compact)));
+    } else {
+        sendReply("DESCRIBE_ACK");
+    }
+}
+
+// SAMPLE {"sensor":"temp","value":21.5[,"ts":<epoch ms>]}
+// SAMPLE {"sensor":"temp","values":[...],"ts":<epoch ms>,"period_ms":100}
+void IoTropolisUnitConnection::handleSample(const QByteArray& data)
+{
+    if (!m_describeDone) {
+        failProtocol("SAMPLE before DESCRIBE", "ERROR: Describe first");
+        return;
+    }
+
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+
+    const int idx = sensorIndex(obj.value("sensor").toString());
+    if (idx < 0) {
+        sendReply("ERROR: Unknown sensor");
+        return;
+    }
+
+    const IOComponent::ValueKind kind = m_sensors.at(idx).valueKind();
+    if (kind == IOComponent::ValueKind::Unknown) {
+        sendReply("ERROR: Sensor format not numeric");
+        return;
+    }
+
+    qint64 ts = QDateTime::currentMSecsSinceEpoch();
+    if (obj.contains("ts") && !sampleTimestamp(obj.value("ts"), &ts)) {
+        sendReply("ERROR: Invalid timestamp");
+        return;
+    }
+
+    QJsonArray values;
+    if (obj.contains("values")) {
+        const QJsonValue v = obj.value("values");
+        if (!v.isArray()) {
+            sendReply("ERROR: Values must be an array");
+            return;
+        }
+        values = v.toArray();
+    } else {
+        values.append(obj.value("value"));
+    }
+
+    qint64 period = 0;
+    if (obj.contains("period_ms") && !samplePeriod(obj.value("period_ms"), &period)) {
+        sendReply("ERROR: Invalid period");
+        return;
+    }
+
+    // The batch spans ts .. ts + (n-1) * period; both ends must be in range.
+    // Divide rather than multiply so a large period cannot overflow.
+    if (period != 0 && values.size() > 1 &&
+        qint64(values.size() - 1) > (MaxSampleTimestampMs - ts) / period) {
+        sendReply("ERROR: Invalid timestamp");
+        return;
+    }
+
+    SensorSampleBatch batch;
+    batch.reserve(values.size());
+    for (int i = 0; i < values.size(); ++i) {
+        SensorSample s;
+        s.unitID = m_unitID;
+        s.sensorIndex = quint16(idx);
+        s.timestampMs = ts + i * period;
+        if (!sampleValue(values.at(i), kind, &s.value)) {
+            sendReply("ERROR: Sample value does not match format");
+            return;
+        }
+        batch.append(s);
+    }
+
+    if (!batch.isEmpty() && m_observer)
+        m_observer->onUnitSamples(this, batch);
 }
 
 void IoTropolisUnitConnection::handleUnknownCommand(const QString& command)
@@ -105,43 +319,87 @@ void IoTropolisUnitConnection::handleUnknownCommand(const QString& command)
 // PROTOCOL HELPERS (Behavior unchanged)
 // ------------------------------------------------------------
 
-bool IoTropolisUnitConnection::parseComponents(const QJsonArray& array, QList<IOComponent>& list, const QString& label)
-{
-    list.clear();
-    for (const auto& val : array) {
-        bool ok = false;
-        IOComponent comp = IOComponent::fromJson(val.toObject(), &ok);
-        if (!ok) {
-            failProtocol("Invalid " + label, "ERROR: JSON Format");
-            return false;
-        }
-        list.append(comp);
-    }
-    return true;
-}
-
 void IoTropolisUnitConnection::sendReply(const QString& msg)
 {
-    if (m_socket && m_socket->isOpen()) {
-        m_socket->write(msg.toUtf8() + "\n");
+    const QByteArray line = msg.toUtf8();
+
+    if (m_transport && m_transport->isOpen()) {
+        m_transport->write(line + "\n");
+    } else if (m_socket && m_socket->isOpen()) {
+        m_socket->write(line + "\n");
+    } else {
+        return;
     }
+
+    if (m_recorder)
+        m_recorder->record(CaptureFormat::RecordKind::Outbound, m_captureSession,
+                           CaptureFormat::redactSecrets(line));
 }
 
 void IoTropolisUnitConnection::failProtocol(const QString& reason, const QString& clientMsg)
 {
     qWarning() << "[IoTropolis] Protocol Error:" << reason;
+    // Before closing: a QTcpSocket with nothing left to write reports the
+    // disconnect synchronously
+    if (m_observer)
+        m_observer->onUnitProtocolError(this, reason);
     if (!clientMsg.isEmpty()) sendReply(clientMsg);
-    m_socket->disconnectFromHost();
+    closeTransport();
+}
+
+void IoTropolisUnitConnection::closeTransport()
+{
+    m_closed = true;
+    if (m_transport) m_transport->close();
+    else if (m_socket) m_socket->disconnectFromHost();
+}
+
+void IoTropolisUnitConnection::closeConnection(const QString& reason, const QString& clientMsg)
+{
+    // Server-side decision (admission, timeout), not a protocol violation
+    qDebug() << "[IoTropolis] Closing connection from" << ipAddress() << ":" << reason;
+    if (!clientMsg.isEmpty()) sendReply(clientMsg);
+    closeTransport();
 }
 
 void IoTropolisUnitConnection::resetUnknownCommandCounter() { m_unknownCommandCount = 0; }
-void IoTropolisUnitConnection::onDisconnected() { emit disconnected(); m_socket->deleteLater(); }
+void IoTropolisUnitConnection::onDisconnected()
+{
+    recordClose();
+    m_socket->deleteLater();
+    if (m_observer)
+        m_observer->onUnitDisconnected(this);
+}
+
+// ------------------------------------------------------------
+// SESSION CAPTURE
+// ------------------------------------------------------------
+void IoTropolisUnitConnection::setRecorder(SessionRecorder* recorder)
+{
+    recordClose();
+
+    m_recorder = recorder;
+    if (m_recorder)
+        m_captureSession = m_recorder->openSession(ipAddress());
+}
+
+void IoTropolisUnitConnection::recordClose()
+{
+    if (!m_recorder)
+        return;
+
+    m_recorder->record(CaptureFormat::RecordKind::Close, m_captureSession, nullptr, 0);
+    m_recorder = nullptr;
+}
 
 // -----------------------------------------------------------------------------
 // IP address (normalized)
 // -----------------------------------------------------------------------------
 QString IoTropolisUnitConnection::ipAddress() const
 {
+    if (!m_transportAddress.isEmpty())
+        return m_transportAddress;
+
     if (!m_socket)
         return {};
 
@@ -151,6 +409,26 @@ QString IoTropolisUnitConnection::ipAddress() const
     return ipStr;
 }
 
+qint64 IoTropolisUnitConnection::memoryBytes() const
+{
+    qint64 bytes = qint64(sizeof(*this)) + MemoryStats::QObjectOverhead +
+                   MemoryStats::bytes(m_transportAddress) +
+                   MemoryStats::bytes(m_identity) +
+                   MemoryStats::bytes(m_identitySecret) +
+                   MemoryStats::bytes(m_unitType) +
+                   MemoryStats::bytes(m_unitSubtype) +
+                   MemoryStats::bytes(m_sensors) +
+                   MemoryStats::bytes(m_actuators) +
+                   m_parser.memoryBytes();
+
+    if (m_transport)
+        bytes += m_transport->memoryBytes();
+    else if (m_socket)
+        bytes += qint64(sizeof(QTcpSocket)) + m_socket->bytesAvailable() + m_socket->bytesToWrite();
+
+    return bytes;
+}
+
 // -----------------------------------------------------------------------------
 // Convenience accessors for GUI and Logging
 // -----------------------------------------------------------------------------
@@ -162,6 +440,15 @@ QStringList IoTropolisUnitConnection::sensorNames() const
     return names;
 }
 
+int IoTropolisUnitConnection::sensorIndex(const QString& name) const
+{
+    for (int i = 0; i < m_sensors.size(); ++i) {
+        if (m_sensors.at(i).name() == name)
+            return i;
+    }
+    return -1;
+}
+
 QStringList IoTropolisUnitConnection::actuatorNames() const
 {
     QStringList names;
@@ -0,0 +1,514 @@
+#include "registration/UnitRegistry.h"
+#include "metrics/MemoryStats.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDebug>
+
+namespace {
+
+// Record, its m_units node and one index entry per type and sensor
+qint64 recordBytes(const UnitRecord& r)
+{
+    return qint64(sizeof(UnitRecord)) +
+           MemoryStats::HashNodeOverhead * (2 + r.sensors.size()) +
+           MemoryStats::bytes(r.identity) +
+           MemoryStats::bytes(r.ipAddress) +
+           MemoryStats::bytes(r.unitType) +
+           MemoryStats::bytes(r.unitSubtype) +
+           MemoryStats::bytes(r.sensors) +
+           MemoryStats::bytes(r.actuators);
+}
+
+qint64 identityBytes(const QString& identity)
+{
+    return MemoryStats::HashNodeOverhead + qint64(sizeof(QString) + sizeof(UnitID)) +
+           MemoryStats::bytes(identity);
+}
+
+qint64 secretBytes(const QString& identity, const QByteArray& secretHash)
+{
+    return MemoryStats::HashNodeOverhead + qint64(sizeof(QString) + sizeof(QByteArray)) +
+           MemoryStats::bytes(identity) + MemoryStats::bytes(secretHash);
+}
+
+} // namespace
+
+int UnitRecord::sensorIndex(const QString& name) const
+{
+    for (int i = 0; i < sensors.size(); ++i) {
+        if (sensors.at(i).name() == name)
+            return i;
+    }
+    return -1;
+}
+
+// ------------------------------------------------------------
+// SERIALIZATION
+// ------------------------------------------------------------
+QDataStream& operator<<(QDataStream& out, const IOComponent& c)
+{
+    return out << c.name() << c.format();
+}
+
+QDataStream& operator>>(QDataStream& in, IOComponent& c)
+{
+    QString name, format;
+    in >> name >> format;
+    c = IOComponent(name, format);
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const UnitRecord& r)
+{
+    return out << r.unitID << r.originNode << r.identity << r.ipAddress
+               << r.unitType << r.unitSubtype
+               << r.sensors << r.actuators;
+}
+
+QDataStream& operator>>(QDataStream& in, UnitRecord& r)
+{
+    return in >> r.unitID >> r.originNode >> r.identity >> r.ipAddress
+              >> r.unitType >> r.unitSubtype
+              >> r.sensors >> r.actuators;
+}
+
+QDataStream& operator<<(QDataStream& out, const RegistryDelta& d)
+{
+    out << quint8(d.kind) << d.seq;
+
+    switch (d.kind) {
+    case RegistryDelta::Kind::UnitRegistered:
+    case RegistryDelta::Kind::UnitRemoved:
+    case RegistryDelta::Kind::TypeCreated:
+        out << d.record;
+        break;
+    case RegistryDelta::Kind::IdsReserved:
+        out << d.unitID;
+        break;
+    case RegistryDelta::Kind::IdentityBound:
+        out << d.identity << d.unitID << d.secretHash;
+        break;
+    }
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, RegistryDelta& d)
+{
+    quint8 kind = 0;
+    in >> kind >> d.seq;
+    d.kind = RegistryDelta::Kind(kind);
+
+    switch (d.kind) {
+    case RegistryDelta::Kind::UnitRegistered:
+    case RegistryDelta::Kind::UnitRemoved:
+    case RegistryDelta::Kind::TypeCreated:
+        in >> d.record;
+        d.unitID = d.record.unitID;
+        break;
+    case RegistryDelta::Kind::IdsReserved:
+        in >> d.unitID;
+        break;
+    case RegistryDelta::Kind::IdentityBound:
+        in >> d.identity >> d.unitID;
+        // Records written before secrets were issued end here
+        if (!in.atEnd())
+            in >> d.secretHash;
+        break;
+    default:
+        in.setStatus(QDataStream::ReadCorruptData);
+        break;
+    }
+    return in;
+}
+
+// ------------------------------------------------------------
+// UNITS
+// ------------------------------------------------------------
+void UnitRegistry::setNodeID(quint8 nodeID)
+{
+    QWriteLocker locker(&m_lock);
+    m_nodeID = nodeID;
+}
+
+quint8 UnitRegistry::nodeID() const
+{
+    QReadLocker locker(&m_lock);
+    return m_nodeID;
+}
+
+void UnitRegistry::insert(const UnitRecord& record)
+{
+    QVector<RegistryDelta> deltas;
+    {
+        QWriteLocker locker(&m_lock);
+
+        RegistryDelta d = nextDelta(RegistryDelta::Kind::UnitRegistered);
+        d.unitID = record.unitID;
+        d.record = record;
+        d.record.originNode = m_nodeID;
+
+        insertLocked(d.record);
+        deltas.append(d);
+    }
+    notify(deltas);
+}
+
+void UnitRegistry::remove(UnitID unitID)
+{
+    QVector<RegistryDelta> deltas;
+    {
+        QWriteLocker locker(&m_lock);
+
+        auto it = m_units.constFind(unitID);
+        if (it == m_units.constEnd() || it->originNode != m_nodeID)
+            return;
+
+        RegistryDelta d = nextDelta(RegistryDelta::Kind::UnitRemoved);
+        d.unitID = unitID;
+        d.record = it.value();
+
+        removeLocked(unitID);
+        deltas.append(d);
+    }
+    notify(deltas);
+}
+
+void UnitRegistry::insertLocked(const UnitRecord& record)
+{
+    removeLocked(record.unitID);
+
+    m_memoryBytes += recordBytes(record);
+    m_units.insert(record.unitID, record);
+    m_byType[record.unitType].insert(record.unitID);
+    for (const auto& s : record.sensors)
+        m_bySensor[s.name()].insert(record.unitID);
+}
+
+bool UnitRegistry::removeLocked(UnitID unitID)
+{
+    auto it = m_units.find(unitID);
+    if (it == m_units.end())
+        return false;
+
+    const UnitRecord& record = it.value();
+
+    auto typeIt = m_byType.find(record.unitType);
+    if (typeIt != m_byType.end()) {
+        typeIt->remove(unitID);
+        if (typeIt->isEmpty())
+            m_byType.erase(typeIt);
+    }
+
+    for (const auto& s : record.sensors) {
+        auto sensorIt = m_bySensor.find(s.name());
+        if (sensorIt == m_bySensor.end())
+            continue;
+        sensorIt->remove(unitID);
+        if (sensorIt->isEmpty())
+            m_bySensor.erase(sensorIt);
+    }
+
+    m_memoryBytes -= recordBytes(record);
+    m_units.erase(it);
+    return true;
+}
+
+bool UnitRegistry::find(UnitID unitID, UnitRecord* out) const
+{
+    QReadLocker locker(&m_lock);
+
+    auto it = m_units.constFind(unitID);
+    if (it == m_units.constEnd())
+        return false;
+
+    if (out)
+        *out = it.value();
+    return true;
+}
+
+QVector<UnitRecord> UnitRegistry::unitsMatching(const QString& unitType,
+                                                const QString& sensorName) const
+{
+    QReadLocker locker(&m_lock);
+
+    QVector<UnitRecord> out;
+
+    // Walk the smaller index and check the other filter per unit
+    const QSet<UnitID>* candidates = nullptr;
+    if (!unitType.isEmpty()) {
+        auto it = m_byType.constFind(unitType);
+        if (it == m_byType.constEnd())
+            return out;
+        candidates = &it.value();
+    }
+    if (!sensorName.isEmpty()) {
+        auto it = m_bySensor.constFind(sensorName);
+        if (it == m_bySensor.constEnd())
+            return out;
+        if (!candidates || it->size() < candidates->size())
+            candidates = &it.value();
+    }
+
+    if (!candidates) {
+        out.reserve(m_units.size());
+        for (const auto& r : m_units)
+            out.append(r);
+        return out;
+    }
+
+    for (UnitID id : *candidates) {
+        auto it = m_units.constFind(id);
+        if (it == m_units.constEnd())
+            continue;
+
+        const UnitRecord& r = it.value();
+        if (!unitType.isEmpty() && r.unitType != unitType)
+            continue;
+        if (!sensorName.isEmpty() && r.sensorIndex(sensorName) < 0)
+            continue;
+        out.append(r);
+    }
+    return out;
+}
+
+int UnitRegistry::size() const
+{
+    QReadLocker locker(&m_lock);
+    return m_units.size();
+}
+
+qint64 UnitRegistry::memoryBytes() const
+{
+    QReadLocker locker(&m_lock);
+    return m_memoryBytes;
+}
+
+// ------------------------------------------------------------
+// STABLE IDENTITIES
+// ------------------------------------------------------------
+UnitID UnitRegistry::allocateUnitID()
+{
+    QVector<RegistryDelta> deltas;
+    UnitID id;
+    {
+        QWriteLocker locker(&m_lock);
+
+        // Every ID below the mark may still be bound to an identity, so
+        // wrapping around would hand out duplicates
+        if (m_nextUnitID > LocalIdMask)
+            return 0;
+
+        const UnitID local = m_nextUnitID++;
+        if (local == LocalIdMask)
+            qWarning() << "[IoTropolis] Local UnitID space exhausted, new units are rejected";
+
+        if (local > m_reservedUpTo) {
+            m_reservedUpTo = qMin<UnitID>(local - 1 + IdReserveBlock, LocalIdMask);
+
+            RegistryDelta d = nextDelta(RegistryDelta::Kind::IdsReserved);
+            d.unitID = m_reservedUpTo;
+            deltas.append(d);
+        }
+
+        id = (UnitID(m_nodeID) << NodeIdShift) | local;
+    }
+    notify(deltas);
+    return id;
+}
+
+void UnitRegistry::bindIdentityLocked(const QString& identity, UnitID unitID,
+                                      const QByteArray& secretHash)
+{
+    auto it = m_identities.find(identity);
+    if (it == m_identities.end()) {
+        m_memoryBytes += identityBytes(identity);
+        m_identities.insert(identity, unitID);
+    } else {
+        it.value() = unitID;
+    }
+
+    // An empty hash (legacy record) never clears a bound secret
+    if (secretHash.isEmpty())
+        return;
+
+    auto secret = m_identitySecrets.find(identity);
+    if (secret == m_identitySecrets.end()) {
+        m_memoryBytes += secretBytes(identity, secretHash);
+        m_identitySecrets.insert(identity, secretHash);
+    } else {
+        secret.value() = secretHash;
+    }
+}
+
+UnitID UnitRegistry::unitIDForIdentity(const QString& identity) const
+{
+    QReadLocker locker(&m_lock);
+    return m_identities.value(identity, 0);
+}
+
+QByteArray UnitRegistry::identitySecretHash(const QString& identity) const
+{
+    QReadLocker locker(&m_lock);
+    return m_identitySecrets.value(identity);
+}
+
+void UnitRegistry::bindIdentity(const QString& identity, UnitID unitID,
+                                const QByteArray& secretHash)
+{
+    QVector<RegistryDelta> deltas;
+    {
+        QWriteLocker locker(&m_lock);
+        if (m_identities.value(identity, 0) == unitID &&
+            m_identitySecrets.value(identity) == secretHash)
+            return;
+        bindIdentityLocked(identity, unitID, secretHash);
+
+        RegistryDelta d = nextDelta(RegistryDelta::Kind::IdentityBound);
+        d.identity = identity;
+        d.unitID = unitID;
+        d.secretHash = secretHash;
+        deltas.append(d);
+    }
+    notify(deltas);
+}
+
+// ------------------------------------------------------------
+// PERSISTENCE
+// ------------------------------------------------------------
+RegistrySnapshot UnitRegistry::snapshot() const
+{
+    QReadLocker locker(&m_lock);
+
+    RegistrySnapshot s;
+    s.seq             = m_seq;
+    s.reservedUpTo    = m_reservedUpTo;
+    s.identities      = m_identities;
+    s.identitySecrets = m_identitySecrets;
+    s.units           = m_units;
+    return s;
+}
+
+void UnitRegistry::restore(const RegistrySnapshot& snapshot)
+{
+    QWriteLocker locker(&m_lock);
+
+    for (auto it = m_identities.constBegin(); it != m_identities.constEnd(); ++it)
+        m_memoryBytes -= identityBytes(it.key());
+    for (auto it = snapshot.identities.constBegin(); it != snapshot.identities.constEnd(); ++it)
+        m_memoryBytes += identityBytes(it.key());
+    for (auto it = m_identitySecrets.constBegin(); it != m_identitySecrets.constEnd(); ++it)
+        m_memoryBytes -= secretBytes(it.key(), it.value());
+    for (auto it = snapshot.identitySecrets.constBegin(); it != snapshot.identitySecrets.constEnd(); ++it)
+        m_memoryBytes += secretBytes(it.key(), it.value());
+
+    m_seq             = snapshot.seq;
+    m_identities      = snapshot.identities;
+    m_identitySecrets = snapshot.identitySecrets;
+    m_reservedUpTo    = snapshot.reservedUpTo;
+    m_nextUnitID      = qMax<UnitID>(m_nextUnitID, m_reservedUpTo + 1);
+}
+
+void UnitRegistry::replay(const RegistryDelta& delta)
+{
+    QWriteLocker locker(&m_lock);
+
+    if (delta.seq <= m_seq)
+        return;
+    m_seq = delta.seq;
+
+    switch (delta.kind) {
+    case RegistryDelta::Kind::IdentityBound:
+        bindIdentityLocked(delta.identity, delta.unitID, delta.secretHash);
+        break;
+    case RegistryDelta::Kind::IdsReserved:
+        // Anything up to the mark may have been handed out before the restart
+        m_reservedUpTo = qMax(m_reservedUpTo, delta.unitID);
+        m_nextUnitID   = qMax<UnitID>(m_nextUnitID, m_reservedUpTo + 1);
+        break;
+    case RegistryDelta::Kind::UnitRegistered:
+    case RegistryDelta::Kind::UnitRemoved:
+        // Connections do not survive a restart
+        break;
+    case RegistryDelta::Kind::TypeCreated:
+        // Types persist in the unit type directory
+        break;
+    }
+}
+
+// ------------------------------------------------------------
+// REPLICATION
+// ------------------------------------------------------------
+void UnitRegistry::applyRemote(const RegistryDelta& delta)
+{
+    QWriteLocker locker(&m_lock);
+
+    switch (delta.kind) {
+    case RegistryDelta::Kind::UnitRegistered: {
+        // Never let a peer's entry replace a unit connected here
+        auto it = m_units.constFind(delta.record.unitID);
+        if (delta.record.originNode != m_nodeID &&
+            (it == m_units.constEnd() || it->originNode != m_nodeID))
+            insertLocked(delta.record);
+        break;
+    }
+    case RegistryDelta::Kind::UnitRemoved: {
+        // Only drop the entry if the peer still owns it; the unit may
+        // already have reconnected here.
+        auto it = m_units.constFind(delta.unitID);
+        if (it != m_units.constEnd() && it->originNode == delta.record.originNode)
+            removeLocked(delta.unitID);
+        break;
+    }
+    case RegistryDelta::Kind::IdentityBound:
+        bindIdentityLocked(delta.identity, delta.unitID, delta.secretHash);
+        break;
+    case RegistryDelta::Kind::IdsReserved:
+    case RegistryDelta::Kind::TypeCreated:
+        break;
+    }
+}
+
+void UnitRegistry::replaceOrigin(quint8 originNode, const QVector<UnitRecord>& units)
+{
+    QWriteLocker locker(&m_lock);
+
+    if (originNode == m_nodeID)
+        return;
+
+    QVector<UnitID> stale;
+    for (const auto& r : m_units) {
+        if (r.originNode == originNode)
+            stale.append(r.unitID);
+    }
+    for (UnitID id : stale)
+        removeLocked(id);
+
+    for (const auto& r : units) {
+        auto it = m_units.constFind(r.unitID);
+        if (r.originNode == originNode &&
+            (it == m_units.constEnd() || it->originNode != m_nodeID))
+            insertLocked(r);
+    }
+}
+
+void UnitRegistry::addDeltaListener(DeltaListener listener)
+{
+    m_listeners.push_back(std::move(listener));
+}
+
+RegistryDelta UnitRegistry::nextDelta(RegistryDelta::Kind kind)
+{
+    RegistryDelta d;
+    d.kind = kind;
+    d.seq = ++m_seq;
+    return d;
+}
+
+void UnitRegistry::notify(const QVector<RegistryDelta>& deltas)
+{
+    for (const auto& d : deltas) {
+        for (const auto& listener : m_listeners)
+            listener(d);
+    }
+}
@@ -0,0 +1,213 @@
+#include "registration/UnitTypeCatalog.h"
+#include "metrics/MemoryStats.h"
+
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+
+namespace {
+
+QList<IOComponent> componentsFromJson(const QJsonArray& array)
+{
+    QList<IOComponent> out;
+    for (const auto& v : array) {
+        if (v.isObject())
+            out.append(IOComponent::fromJson(v.toObject()));
+    }
+    return out;
+}
+
+QStringList validateComponents(const QList<IOComponent>& expected,
+                               const QList<IOComponent>& actual)
+{
+    QStringList missing;
+
+    for (const auto& e : expected) {
+        bool found = false;
+        for (const auto& a : actual) {
+            if (a.name() == e.name() &&
+                a.format() == e.format()) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            missing << e.name();
+    }
+    return missing;
+}
+
+QJsonArray componentsToJson(const QList<IOComponent>& comps)
+{
+    QJsonArray arr;
+    for (const auto& c : comps)
+        arr.append(c.toJson());
+    return arr;
+}
+
+} // namespace
+
+UnitTypeCatalog::UnitTypeCatalog(const QString& dir)
+    : m_dir(dir)
+{
+    QDir d;
+    if (!d.exists(m_dir))
+        d.mkpath(m_dir);
+}
+
+void UnitTypeCatalog::setDirectory(const QString& dir)
+{
+    if (dir == m_dir)
+        return;
+
+    QDir d;
+    if (!d.exists(dir))
+        d.mkpath(dir);
+
+    qDebug() << "[IoTropolis] Unit type directory changed to" << dir;
+    m_dir = dir;
+}
+
+qint64 UnitTypeCatalog::memoryBytes() const
+{
+    return qint64(sizeof(*this)) + MemoryStats::bytes(m_dir);
+}
+
+QString UnitTypeCatalog::fileFor(const QString& unitType, const QString& unitSubtype) const
+{
+    return QString("%1/%2_%3.json").arg(m_dir, unitType, unitSubtype);
+}
+
+UnitTypeCatalog::Result UnitTypeCatalog::validateOrCreate(const UnitRecord& unit, QString* error)
+{
+    const QString filename = fileFor(unit.unitType, unit.unitSubtype);
+    QFile file(filename);
+
+    if (!file.exists()) {
+        if (!writeType(unit, filename)) {
+            *error = "Cannot create type file";
+            return Result::Error;
+        }
+
+        qDebug() << "[IoTropolis] Created new type file:" << filename;
+
+        if (m_listener)
+            m_listener(unit);
+        return Result::Created;
+    }
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = "Cannot open type file for validation";
+        return Result::Error;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    file.close();
+
+    if (!doc.isObject()) {
+        *error = "Persistent type file corrupted";
+        return Result::Error;
+    }
+
+    QJsonObject obj = doc.object();
+
+    QList<IOComponent> pSensors =
+        componentsFromJson(obj.value("sensors").toArray());
+    QList<IOComponent> pActuators =
+        componentsFromJson(obj.value("actuators").toArray());
+
+    QStringList missingSensors =
+        validateComponents(pSensors, unit.sensors);
+    QStringList missingActuators =
+        validateComponents(pActuators, unit.actuators);
+
+    if (!missingSensors.isEmpty() || !missingActuators.isEmpty()) {
+        QString msg = "DESCRIBE validation failed. ";
+        if (!missingSensors.isEmpty())
+            msg += "Missing/mismatched sensors: " +
+                   missingSensors.join(", ") + ". ";
+        if (!missingActuators.isEmpty())
+            msg += "Missing/mismatched actuators: " +
+                   missingActuators.join(", ") + ". ";
+        *error = msg;
+        return Result::Error;
+    }
+
+    return Result::Matched;
+}
+
+bool UnitTypeCatalog::ensureType(const UnitRecord& type)
+{
+    const QString filename = fileFor(type.unitType, type.unitSubtype);
+    if (QFile::exists(filename))
+        return true;
+
+    if (!writeType(type, filename))
+        return false;
+
+    qDebug() << "[IoTropolis] Stored type file from peer:" << filename;
+    return true;
+}
+
+bool UnitTypeCatalog::writeType(const UnitRecord& type, const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QJsonObject obj;
+    obj["type"]      = type.unitType;
+    obj["subtype"]   = type.unitSubtype;
+    obj["sensors"]   = componentsToJson(type.sensors);
+    obj["actuators"] = componentsToJson(type.actuators);
+
+    QJsonDocument doc(obj);
+    file.write(doc.toJson(QJsonDocument::Indented));
+    file.close();
+    return true;
+}
+
+QVector<UnitRecord> UnitTypeCatalog::types() const
+{
+    QVector<UnitRecord> out;
+
+    const QFileInfoList files =
+        QDir(m_dir).entryInfoList(QStringList() << "*.json", QDir::Files);
+
+    for (const auto& info : files) {
+        QFile file(info.filePath());
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        if (!doc.isObject())
+            continue;
+
+        QJsonObject obj = doc.object();
+
+        UnitRecord type;
+        if (obj.contains("type")) {
+            type.unitType    = obj.value("type").toString();
+            type.unitSubtype = obj.value("subtype").toString();
+        } else {
+            // Files written before type/subtype were stored inline
+            const QString base = info.completeBaseName();
+            const int sep = base.indexOf('_');
+            type.unitType    = base.left(sep);
+            type.unitSubtype = sep < 0 ? QString() : base.mid(sep + 1);
+        }
+        type.sensors   = componentsFromJson(obj.value("sensors").toArray());
+        type.actuators = componentsFromJson(obj.value("actuators").toArray());
+        out.append(type);
+    }
+    return out;
+}
+
+void UnitTypeCatalog::setTypeCreatedListener(TypeCreatedListener listener)
+{
+    m_listener = std::move(listener);
+}
@@ -0,0 +1,600 @@
+#include "replication/IoTropolisReplicationNode.h"
+
+#include <QDataStream>
+#include <QHostAddress>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+
+constexpr QDataStream::Version StreamVersion = QDataStream::Qt_5_12;
+constexpr quint32 MaxFrameLength = 64 * 1024 * 1024;
+
+QByteArray newNonce()
+{
+    quint32 words[IoTropolisReplicationNode::NonceSize / 4];
+    QRandomGenerator::system()->fillRange(words);
+    return QByteArray(reinterpret_cast<const char*>(words), sizeof(words));
+}
+
+// Compare without an early exit, so timing does not reveal the prefix
+bool sameCode(const QByteArray& a, const QByteArray& b)
+{
+    if (a.size() != b.size())
+        return false;
+    char diff = 0;
+    for (int i = 0; i < a.size(); ++i)
+        diff |= char(a.at(i) ^ b.at(i));
+    return diff == 0;
+}
+
+} // namespace
+
+IoTropolisReplicationNode::IoTropolisReplicationNode(UnitRegistry* registry,
+                                                     UnitTypeCatalog* catalog,
+                                                     QObject* parent)
+    : QObject(parent)
+    , m_registry(registry)
+    , m_catalog(catalog)
+    , m_nodeID(registry->nodeID())
+    , m_epoch(QRandomGenerator::global()->generate64())
+{
+}
+
+IoTropolisReplicationNode::~IoTropolisReplicationNode()
+{
+    m_self.reset();
+    if (m_catalog)
+        m_catalog->setTypeCreatedListener(nullptr);
+    qDeleteAll(m_upstreams);
+}
+
+void IoTropolisReplicationNode::setSharedSecret(const QByteArray& secret)
+{
+    m_secret = secret;
+}
+
+bool IoTropolisReplicationNode::start(const QString& bindAddress, quint16 port,
+                                      const QStringList& peers)
+{
+    // The stream carries identities and secret hashes; never serve it
+    // (or apply one) without authenticating the other end
+    if (m_secret.isEmpty()) {
+        qCritical() << "[IoTropolisReplication] No shared secret configured";
+        return false;
+    }
+
+    QHostAddress address(bindAddress);
+    if (bindAddress.isEmpty() || address == QHostAddress::AnyIPv4 || address == QHostAddress::AnyIPv6)
+        address = QHostAddress::Any;
+    if (address.isNull()) {
+        qCritical() << "[IoTropolisReplication] Invalid bind address" << bindAddress;
+        return false;
+    }
+
+    m_nodeID = m_registry->nodeID();
+
+    m_self = std::make_shared<IoTropolisReplicationNode*>(this);
+    std::weak_ptr<IoTropolisReplicationNode*> weak = m_self;
+
+    m_registry->addDeltaListener([weak](const RegistryDelta& d) {
+        if (auto self = weak.lock())
+            (*self)->publish(d);
+    });
+
+    m_catalog->setTypeCreatedListener([this](const UnitRecord& type) {
+        // Only the definition travels; the unit that happened to create the
+        // type (identity, address) stays on this node
+        RegistryDelta d;
+        d.kind = RegistryDelta::Kind::TypeCreated;
+        d.record.unitType    = type.unitType;
+        d.record.unitSubtype = type.unitSubtype;
+        d.record.sensors     = type.sensors;
+        d.record.actuators   = type.actuators;
+        publish(d);
+    });
+
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection,
+            this, &IoTropolisReplicationNode::onNewConnection);
+
+    if (!m_server->listen(address, port)) {
+        qCritical() << "[IoTropolisReplication] Failed to listen on" << bindAddress << "port" << port;
+        return false;
+    }
+
+    for (const QString& peer : peers) {
+        const int colon = peer.lastIndexOf(':');
+        bool ok = false;
+        const quint16 peerPort = colon > 0 ? peer.mid(colon + 1).toUShort(&ok) : 0;
+        if (!ok) {
+            qWarning() << "[IoTropolisReplication] Ignoring malformed peer" << peer;
+            continue;
+        }
+
+        auto* up = new Upstream;
+        up->host = peer.left(colon).trimmed();
+        up->port = peerPort;
+
+        up->purgeTimer = new QTimer(this);
+        up->purgeTimer->setSingleShot(true);
+        up->purgeTimer->setInterval(PurgeDelayMs);
+        connect(up->purgeTimer, &QTimer::timeout, this, [this, up]() { purgeUpstream(up); });
+
+        m_upstreams.append(up);
+        connectUpstream(up);
+    }
+
+    qDebug() << "[IoTropolisReplication] Node" << m_nodeID
+             << "listening on port" << port
+             << "with" << m_upstreams.size() << "peers";
+    return true;
+}
+
+// ------------------------------------------------------------
+// FRAMING
+// ------------------------------------------------------------
+QByteArray IoTropolisReplicationNode::frame(quint8 type, const QByteArray& payload)
+{
+    QByteArray out;
+    out.reserve(5 + payload.size());
+
+    char header[5];
+    qToBigEndian<quint32>(quint32(payload.size() + 1), header);
+    header[4] = char(type);
+
+    out.append(header, 5);
+    out.append(payload);
+    return out;
+}
+
+bool IoTropolisReplicationNode::takeFrame(QByteArray& buffer, quint8* type,
+                                          QByteArray* payload, bool* error)
+{
+    *error = false;
+    if (buffer.size() < 4)
+        return false;
+
+    const quint32 length = qFromBigEndian<quint32>(buffer.constData());
+    if (length == 0 || length > MaxFrameLength) {
+        *error = true;
+        return false;
+    }
+    if (quint32(buffer.size()) < 4 + length)
+        return false;
+
+    *type = quint8(buffer.at(4));
+    *payload = buffer.mid(5, int(length) - 1);
+    buffer.remove(0, int(4 + length));
+    return true;
+}
+
+// ------------------------------------------------------------
+// AUTHENTICATION
+// The role label keeps a subscriber's proof from being reflected back
+// as the node's proof.
+// ------------------------------------------------------------
+QByteArray IoTropolisReplicationNode::authCode(const char* role, const QByteArray& first,
+                                               const QByteArray& second) const
+{
+    return QMessageAuthenticationCode::hash(QByteArray(role) + first + second,
+                                            m_secret, QCryptographicHash::Sha256);
+}
+
+// ------------------------------------------------------------
+// PUBLISHING SIDE
+// ------------------------------------------------------------
+void IoTropolisReplicationNode::publish(RegistryDelta delta)
+{
+    // The allocator is node-local
+    if (delta.kind == RegistryDelta::Kind::IdsReserved)
+        return;
+
+    delta.seq = ++m_seq;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << m_nodeID << m_epoch << delta;
+
+    const QByteArray f = frame(MsgDelta, payload);
+
+    m_log.enqueue(qMakePair(delta.seq, f));
+    while (m_log.size() > MaxRetainedDeltas)
+        m_log.dequeue();
+
+    // A subscriber that stops reading would otherwise grow its send buffer
+    // without bound; drop it and let it resync with HELLO when it returns
+    QList<QTcpSocket*> stalled;
+    for (QTcpSocket* s : qAsConst(m_subscribers)) {
+        if (s->bytesToWrite() > MaxSubscriberBacklog)
+            stalled.append(s);
+        else
+            s->write(f);
+    }
+
+    for (QTcpSocket* s : qAsConst(stalled)) {
+        qWarning() << "[IoTropolisReplication] Subscriber" << s->peerAddress().toString()
+                   << "stalled with" << s->bytesToWrite() << "bytes queued, dropping it";
+        m_subscribers.remove(s);
+        s->abort();
+    }
+}
+
+void IoTropolisReplicationNode::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+
+        Downstream down;
+        down.nonce = newNonce();
+        m_downstreams.insert(socket, down);
+
+        connect(socket, &QTcpSocket::readyRead,
+                this, [this, socket]() { onDownstreamData(socket); });
+
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_subscribers.remove(socket);
+            m_downstreams.remove(socket);
+            socket->deleteLater();
+        });
+
+        QTimer::singleShot(AuthTimeoutMs, socket, [this, socket]() {
+            auto it = m_downstreams.constFind(socket);
+            if (it != m_downstreams.constEnd() && !it->authenticated) {
+                qWarning() << "[IoTropolisReplication] Subscriber" << socket->peerAddress().toString()
+                           << "did not authenticate, closing";
+                socket->abort();
+            }
+        });
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+        out << down.nonce;
+        socket->write(frame(MsgChallenge, payload));
+    }
+}
+
+void IoTropolisReplicationNode::onDownstreamData(QTcpSocket* socket)
+{
+    auto it = m_downstreams.find(socket);
+    if (it == m_downstreams.end())
+        return;
+    Downstream& down = it.value();
+    down.buffer.append(socket->readAll());
+
+    quint8 type;
+    QByteArray payload;
+    bool error = false;
+    while (takeFrame(down.buffer, &type, &payload, &error)) {
+        if (!down.authenticated) {
+            // Only AUTH is accepted first; anything else is a stranger
+            if (type != MsgAuth || !handleAuth(socket, down, payload)) {
+                qWarning() << "[IoTropolisReplication] Subscriber" << socket->peerAddress().toString()
+                           << "failed authentication, closing";
+                socket->abort();
+                return;
+            }
+        } else if (type == MsgHello) {
+            handleHello(socket, payload);
+        }
+    }
+
+    if (error) {
+        qWarning() << "[IoTropolisReplication] Bad frame from subscriber, closing";
+        socket->abort();
+    }
+}
+
+bool IoTropolisReplicationNode::handleAuth(QTcpSocket* socket, Downstream& down,
+                                           const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    QByteArray peerNonce, code;
+    in >> peerNonce >> code;
+    if (in.status() != QDataStream::Ok || peerNonce.size() != NonceSize ||
+        !sameCode(code, authCode("subscribe", down.nonce, peerNonce)))
+        return false;
+
+    down.authenticated = true;
+
+    QByteArray reply;
+    QDataStream out(&reply, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << authCode("publish", peerNonce, down.nonce);
+    socket->write(frame(MsgAuthAck, reply));
+    return true;
+}
+
+void IoTropolisReplicationNode::handleHello(QTcpSocket* socket, const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    quint8 peerNode = 0;
+    quint64 knownEpoch = 0, knownSeq = 0;
+    in >> peerNode >> knownEpoch >> knownSeq;
+
+    const quint64 oldest = m_log.isEmpty() ? m_seq + 1 : m_log.head().first;
+
+    if (knownEpoch == m_epoch && knownSeq <= m_seq && knownSeq + 1 >= oldest) {
+        // Catch up from the retained log
+        int sent = 0;
+        for (const auto& entry : qAsConst(m_log)) {
+            if (entry.first > knownSeq) {
+                socket->write(entry.second);
+                ++sent;
+            }
+        }
+        qDebug() << "[IoTropolisReplication] Node" << peerNode
+                 << "caught up with" << sent << "deltas";
+    } else {
+        sendSnapshot(socket);
+        qDebug() << "[IoTropolisReplication] Node" << peerNode
+                 << "caught up from snapshot at seq" << m_seq;
+    }
+
+    m_subscribers.insert(socket);
+}
+
+void IoTropolisReplicationNode::sendSnapshot(QTcpSocket* socket)
+{
+    const RegistrySnapshot snap = m_registry->snapshot();
+
+    QVector<UnitRecord> units;
+    for (const auto& r : snap.units) {
+        if (r.originNode == m_nodeID)
+            units.append(r);
+    }
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << m_nodeID << m_epoch << m_seq
+        << units << snap.identities << m_catalog->types()
+        << snap.identitySecrets;
+
+    socket->write(frame(MsgSnapshot, payload));
+}
+
+// ------------------------------------------------------------
+// SUBSCRIBING SIDE
+// ------------------------------------------------------------
+void IoTropolisReplicationNode::connectUpstream(Upstream* up)
+{
+    if (!up->socket) {
+        up->socket = new QTcpSocket(this);
+
+        // HELLO follows once the node's CHALLENGE is answered
+        connect(up->socket, &QTcpSocket::readyRead,
+                this, [this, up]() { onUpstreamData(up); });
+
+        connect(up->socket, &QTcpSocket::disconnected, this, [this, up]() {
+            up->buffer.clear();
+            up->resyncing = false;
+            up->authenticated = false;
+            up->nonce.clear();
+            up->peerNonce.clear();
+            if (up->originKnown && !up->purgeTimer->isActive())
+                up->purgeTimer->start();
+            QTimer::singleShot(ReconnectDelayMs, this, [this, up]() { connectUpstream(up); });
+        });
+
+        auto onError = [this, up]() {
+            if (up->socket->state() == QAbstractSocket::UnconnectedState)
+                QTimer::singleShot(ReconnectDelayMs, this, [this, up]() { connectUpstream(up); });
+        };
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        connect(up->socket, &QAbstractSocket::errorOccurred, this, onError);
+#else
+        connect(up->socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
+                this, onError);
+#endif
+    }
+
+    if (up->socket->state() == QAbstractSocket::UnconnectedState)
+        up->socket->connectToHost(up->host, up->port);
+}
+
+void IoTropolisReplicationNode::sendHello(Upstream* up)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << m_nodeID << up->epoch << up->seq;
+
+    up->socket->write(frame(MsgHello, payload));
+}
+
+void IoTropolisReplicationNode::onUpstreamData(Upstream* up)
+{
+    up->buffer.append(up->socket->readAll());
+
+    quint8 type;
+    QByteArray payload;
+    bool error = false;
+    while (takeFrame(up->buffer, &type, &payload, &error)) {
+        if (type == MsgChallenge) {
+            answerChallenge(up, payload);
+        } else if (type == MsgAuthAck) {
+            if (!checkAuthAck(up, payload)) {
+                qWarning() << "[IoTropolisReplication] Peer" << up->host << up->port
+                           << "failed authentication, closing";
+                up->socket->abort();
+                return;
+            }
+        } else if (!up->authenticated) {
+            qWarning() << "[IoTropolisReplication] Unauthenticated data from"
+                       << up->host << up->port << ", closing";
+            up->socket->abort();
+            return;
+        } else if (type == MsgSnapshot) {
+            applySnapshot(up, payload);
+        } else if (type == MsgDelta) {
+            applyDelta(up, payload);
+        }
+    }
+
+    if (error) {
+        qWarning() << "[IoTropolisReplication] Bad frame from" << up->host << up->port;
+        up->socket->abort();
+    }
+}
+
+void IoTropolisReplicationNode::answerChallenge(Upstream* up, const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    QByteArray peerNonce;
+    in >> peerNonce;
+    if (in.status() != QDataStream::Ok || peerNonce.size() != NonceSize ||
+        !up->peerNonce.isEmpty()) {
+        qWarning() << "[IoTropolisReplication] Bad challenge from" << up->host << up->port;
+        up->socket->abort();
+        return;
+    }
+
+    up->peerNonce = peerNonce;
+    up->nonce = newNonce();
+
+    QByteArray reply;
+    QDataStream out(&reply, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << up->nonce << authCode("subscribe", up->peerNonce, up->nonce);
+    up->socket->write(frame(MsgAuth, reply));
+
+    // The node only reads HELLO after checking AUTH
+    sendHello(up);
+}
+
+bool IoTropolisReplicationNode::checkAuthAck(Upstream* up, const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    QByteArray code;
+    in >> code;
+    if (in.status() != QDataStream::Ok || up->nonce.isEmpty() || up->peerNonce.isEmpty() ||
+        !sameCode(code, authCode("publish", up->nonce, up->peerNonce)))
+        return false;
+
+    up->authenticated = true;
+    return true;
+}
+
+void IoTropolisReplicationNode::applySnapshot(Upstream* up, const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    quint8 origin = 0;
+    quint64 epoch = 0, seq = 0;
+    QVector<UnitRecord> units;
+    QHash<QString, UnitID> identities;
+    QVector<UnitRecord> types;
+    QHash<QString, QByteArray> secrets;
+    in >> origin >> epoch >> seq >> units >> identities >> types;
+    // Peers that predate identity secrets end the snapshot here
+    if (!in.atEnd())
+        in >> secrets;
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "[IoTropolisReplication] Corrupted snapshot from" << up->host;
+        up->socket->abort();
+        return;
+    }
+    if (origin == m_nodeID) {
+        qWarning() << "[IoTropolisReplication] Peer" << up->host << up->port
+                   << "uses our node_id" << origin << "; ignoring it";
+        up->socket->abort();
+        return;
+    }
+
+    for (const auto& type : types)
+        m_catalog->ensureType(type);
+
+    for (auto it = identities.constBegin(); it != identities.constEnd(); ++it) {
+        RegistryDelta d;
+        d.kind = RegistryDelta::Kind::IdentityBound;
+        d.identity = it.key();
+        d.unitID = it.value();
+        d.secretHash = secrets.value(it.key());
+        m_registry->applyRemote(d);
+    }
+
+    // The peer's previous incarnation may have owned a different origin
+    if (up->originKnown && up->originNode != origin)
+        m_registry->replaceOrigin(up->originNode, {});
+    m_registry->replaceOrigin(origin, units);
+
+    up->originKnown = true;
+    up->originNode = origin;
+    up->epoch = epoch;
+    up->seq = seq;
+    up->resyncing = false;
+    up->purgeTimer->stop();
+
+    qDebug() << "[IoTropolisReplication] Snapshot from node" << origin
+             << ":" << units.size() << "units at seq" << seq;
+}
+
+void IoTropolisReplicationNode::applyDelta(Upstream* up, const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    quint8 origin = 0;
+    quint64 epoch = 0;
+    RegistryDelta delta;
+    in >> origin >> epoch >> delta;
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "[IoTropolisReplication] Corrupted delta from" << up->host;
+        up->socket->abort();
+        return;
+    }
+
+    if (up->resyncing)
+        return;
+
+    if (!up->originKnown || epoch != up->epoch || delta.seq > up->seq + 1) {
+        // Gap or restarted peer: forget our position and ask for a snapshot
+        qWarning() << "[IoTropolisReplication] Sequence gap from node" << origin
+                   << "; requesting snapshot";
+        up->epoch = 0;
+        up->seq = 0;
+        up->resyncing = true;
+        sendHello(up);
+        return;
+    }
+    if (delta.seq <= up->seq)
+        return;     // already applied
+
+    if (delta.kind == RegistryDelta::Kind::TypeCreated)
+        m_catalog->ensureType(delta.record);
+    else
+        m_registry->applyRemote(delta);
+
+    up->seq = delta.seq;
+    up->purgeTimer->stop();
+}
+
+void IoTropolisReplicationNode::purgeUpstream(Upstream* up)
+{
+    if (!up->originKnown)
+        return;
+
+    qWarning() << "[IoTropolisReplication] Lost node" << up->originNode
+               << "; dropping its units";
+
+    m_registry->replaceOrigin(up->originNode, {});
+    up->originKnown = false;
+    up->epoch = 0;
+    up->seq = 0;
+}
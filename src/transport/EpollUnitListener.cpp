@@ -0,0 +1,430 @@
+#include "transport/EpollUnitListener.h"
+#include "registration/IoTropolisUnitConnection.h"
+#include "metrics/MemoryStats.h"
+
+#include <QHostAddress>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// 100k connections need far more than the usual 1024 descriptors
+void raiseFileLimit()
+{
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+} // namespace
+
+EpollUnitListener::EpollUnitListener(QObject* parent)
+    : QObject(parent)
+{
+    m_readBuffer.resize(ReadChunk);
+}
+
+EpollUnitListener::~EpollUnitListener()
+{
+    for (Connection* c : qAsConst(m_connections)) {
+        ::close(c->fd);
+        if (c->unit)
+            c->unit->transportClosed();
+        m_slab.destroy(c);
+    }
+    m_connections.clear();
+
+    if (m_listenFd >= 0)
+        ::close(m_listenFd);
+    if (m_epollFd >= 0)
+        ::close(m_epollFd);
+}
+
+bool EpollUnitListener::listen(const QString& bindAddress, quint16 port, int backlog)
+{
+    raiseFileLimit();
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        qCritical() << "[IoTropolisEpoll] epoll_create1 failed:" << strerror(errno);
+        return false;
+    }
+
+    const QHostAddress addr(bindAddress);
+    const bool anyAddress = bindAddress.isEmpty() ||
+                            addr == QHostAddress::AnyIPv4 ||
+                            addr == QHostAddress::AnyIPv6;
+    const bool ipv4 = !anyAddress && addr.protocol() == QAbstractSocket::IPv4Protocol;
+
+    m_listenFd = ::socket(ipv4 ? AF_INET : AF_INET6,
+                          SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0) {
+        qCritical() << "[IoTropolisEpoll] socket failed:" << strerror(errno);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int rc;
+    if (ipv4) {
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        sa.sin_addr.s_addr = htonl(addr.toIPv4Address());
+        rc = ::bind(m_listenFd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+    } else {
+        int zero = 0;
+        setsockopt(m_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+        sockaddr_in6 sa{};
+        sa.sin6_family = AF_INET6;
+        sa.sin6_port = htons(port);
+        if (anyAddress) {
+            sa.sin6_addr = in6addr_any;
+        } else {
+            const Q_IPV6ADDR a6 = addr.toIPv6Address();
+            std::memcpy(&sa.sin6_addr, &a6, sizeof(sa.sin6_addr));
+        }
+        rc = ::bind(m_listenFd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+    }
+
+    if (rc < 0 || ::listen(m_listenFd, qMax(1, backlog)) < 0) {
+        qCritical() << "[IoTropolisEpoll] Failed to listen on" << bindAddress << "port" << port
+                    << ":" << strerror(errno);
+        return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = nullptr;              // nullptr marks the listening socket
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev);
+
+    m_notifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated,
+            this, &EpollUnitListener::onEpollReadable);
+
+    qDebug() << "[IoTropolisEpoll] Listening on" << bindAddress << "port" << port
+             << "backlog" << backlog;
+    return true;
+}
+
+void EpollUnitListener::setBacklog(int backlog)
+{
+    // Linux resizes the accept queue when listen() is called again
+    if (m_listenFd >= 0 && ::listen(m_listenFd, qMax(1, backlog)) < 0)
+        qWarning() << "[IoTropolisEpoll] Failed to change backlog:" << strerror(errno);
+}
+
+void EpollUnitListener::setAcceptPaused(bool paused)
+{
+    if (m_acceptPaused == paused)
+        return;
+
+    m_acceptPaused = paused;
+
+    // Edge-triggered: the backlog that built up while paused will not
+    // raise another event, so drain it on the next loop pass
+    if (!paused && m_listenFd >= 0)
+        QMetaObject::invokeMethod(this, [this]() { acceptPending(); },
+                                  Qt::QueuedConnection);
+}
+
+// ------------------------------------------------------------
+// EVENT LOOP
+// ------------------------------------------------------------
+void EpollUnitListener::onEpollReadable()
+{
+    epoll_event events[MaxEventsPerWait];
+    m_inBatch = true;
+
+    for (int round = 0; round < MaxWaitRounds; ++round) {
+        const int n = epoll_wait(m_epollFd, events, MaxEventsPerWait, 0);
+        if (n <= 0)
+            break;
+
+        for (int i = 0; i < n; ++i) {
+            auto* c = static_cast<Connection*>(events[i].data.ptr);
+            if (!c) {
+                acceptPending();
+                continue;
+            }
+            if (c->dead)
+                continue;
+
+            const quint32 ev = events[i].events;
+            if (ev & (EPOLLIN | EPOLLRDHUP))
+                handleReadable(c);
+            if ((ev & (EPOLLERR | EPOLLHUP)) && !c->dead)
+                scheduleTeardown(c);
+            if ((ev & EPOLLOUT) && !c->dead && !c->out.isEmpty())
+                markDirty(c);
+        }
+
+        if (n < MaxEventsPerWait)
+            break;
+    }
+
+    m_inBatch = false;
+    flushPending();
+}
+
+void EpollUnitListener::flushPending()
+{
+    m_flushScheduled = false;
+
+    // One writev per connection for everything queued since the last flush
+    const QVector<Connection*> dirty = m_dirty;
+    m_dirty.clear();
+    for (Connection* c : dirty) {
+        c->dirty = false;
+        if (!c->dead)
+            flush(c);
+    }
+
+    const QVector<Connection*> closing = m_closing;
+    m_closing.clear();
+    for (Connection* c : closing)
+        teardown(c);
+}
+
+void EpollUnitListener::acceptPending()
+{
+    while (!m_acceptPaused) {
+        sockaddr_storage peer;
+        socklen_t len = sizeof(peer);
+        const int fd = accept4(m_listenFd, reinterpret_cast<sockaddr*>(&peer), &len,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qWarning() << "[IoTropolisEpoll] accept failed:" << strerror(errno);
+            return;
+        }
+
+        Connection* c = m_slab.create(this, fd);
+        c->index = m_connections.size();
+        m_connections.append(c);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev);
+
+        c->unit = new IoTropolisUnitConnection(c);
+        emit newUnit(c->unit);
+    }
+}
+
+// ------------------------------------------------------------
+// READ PATH
+// ------------------------------------------------------------
+void EpollUnitListener::handleReadable(Connection* c)
+{
+    // Edge-triggered: read until the kernel buffer is empty
+    while (!c->dead) {
+        const ssize_t n = ::read(c->fd, m_readBuffer.data(), ReadChunk);
+        if (n > 0) {
+            consume(c, m_readBuffer.constData(), int(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        // EOF or hard error
+        scheduleTeardown(c);
+        return;
+    }
+}
+
+void EpollUnitListener::consume(Connection* c, const char* data, int length)
+{
+    const char* p = data;
+    const char* end = data + length;
+
+    while (p < end && !c->dead && !c->closing) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (!nl) {
+            c->in.append(p, int(end - p));
+            if (c->in.size() > MaxLineLength) {
+                qWarning() << "[IoTropolisEpoll] Line too long, closing connection";
+                scheduleTeardown(c);
+            }
+            return;
+        }
+
+        if (c->in.isEmpty()) {
+            c->unit->processLine(QByteArray(p, int(nl - p)));
+        } else {
+            c->in.append(p, int(nl - p));
+            const QByteArray line = c->in;
+            c->in.clear();
+            c->unit->processLine(line);
+        }
+        p = nl + 1;
+    }
+}
+
+// ------------------------------------------------------------
+// WRITE PATH
+// ------------------------------------------------------------
+void EpollUnitListener::Connection::write(const QByteArray& data)
+{
+    if (!isOpen())
+        return;
+    out.append(data);
+    owner->markDirty(this);
+}
+
+void EpollUnitListener::Connection::close()
+{
+    if (closing || dead)
+        return;
+    closing = true;
+    owner->markDirty(this);
+}
+
+QString EpollUnitListener::Connection::peerAddress() const
+{
+    sockaddr_storage peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &len) != 0)
+        return {};
+    return QHostAddress(reinterpret_cast<const sockaddr*>(&peer)).toString();
+}
+
+qint64 EpollUnitListener::Connection::memoryBytes() const
+{
+    qint64 bytes = qint64(sizeof(Connection)) + MemoryStats::bytes(in);
+    for (const QByteArray& chunk : out)
+        bytes += MemoryStats::bytes(chunk);
+    return bytes;
+}
+
+void EpollUnitListener::markDirty(Connection* c)
+{
+    if (c->dirty)
+        return;
+    c->dirty = true;
+    m_dirty.append(c);
+
+    // Writes issued outside an epoll batch (e.g. from a timer) are
+    // flushed on the next event loop pass
+    if (!m_inBatch && !m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { flushPending(); },
+                                  Qt::QueuedConnection);
+    }
+}
+
+void EpollUnitListener::flush(Connection* c)
+{
+    while (!c->out.isEmpty()) {
+        iovec iov[MaxIovecs];
+        int count = 0;
+        for (; count < c->out.size() && count < MaxIovecs; ++count) {
+            const QByteArray& chunk = c->out.at(count);
+            const int skip = count == 0 ? c->outOffset : 0;
+            iov[count].iov_base = const_cast<char*>(chunk.constData()) + skip;
+            iov[count].iov_len = size_t(chunk.size() - skip);
+        }
+
+        ssize_t n = ::writev(c->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;         // EPOLLOUT will resume
+            scheduleTeardown(c);
+            return;
+        }
+
+        // Drop fully written chunks
+        while (n > 0 && !c->out.isEmpty()) {
+            const qint64 left = c->out.first().size() - c->outOffset;
+            if (n >= left) {
+                n -= left;
+                c->out.removeFirst();
+                c->outOffset = 0;
+            } else {
+                c->outOffset += int(n);
+                n = 0;
+            }
+        }
+    }
+
+    c->out.squeeze();
+    if (c->closing)
+        scheduleTeardown(c);
+}
+
+// ------------------------------------------------------------
+// TEARDOWN
+// ------------------------------------------------------------
+void EpollUnitListener::scheduleTeardown(Connection* c)
+{
+    if (c->dead)
+        return;
+    c->dead = true;
+    m_closing.append(c);
+
+    if (!m_inBatch && !m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { flushPending(); },
+                                  Qt::QueuedConnection);
+    }
+}
+
+void EpollUnitListener::teardown(Connection* c)
+{
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+
+    // Swap-remove from the live list
+    Connection* last = m_connections.last();
+    last->index = c->index;
+    m_connections[c->index] = last;
+    m_connections.removeLast();
+
+    IoTropolisUnitConnection* unit = c->unit;
+    m_slab.destroy(c);
+
+    // The unit reports the disconnect; its owner deletes it
+    if (unit)
+        unit->transportClosed();
+}
+
+#else // !Q_OS_LINUX
+
+EpollUnitListener::EpollUnitListener(QObject* parent) : QObject(parent) {}
+EpollUnitListener::~EpollUnitListener() = default;
+
+bool EpollUnitListener::listen(const QString&, quint16, int)
+{
+    qCritical() << "[IoTropolisEpoll] The epoll transport is only available on Linux";
+    return false;
+}
+
+void EpollUnitListener::setAcceptPaused(bool paused) { m_acceptPaused = paused; }
+void EpollUnitListener::setBacklog(int) {}
+void EpollUnitListener::onEpollReadable() {}
+void EpollUnitListener::flushPending() {}
+
+#endif // Q_OS_LINUX
@@ -0,0 +1,272 @@
+#include "transport/UdpIngestListener.h"
+
+#include <QDateTime>
+#include <QHostAddress>
+#include <QThread>
+#include <QtEndian>
+#include <QDebug>
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Same rules as a JSON SAMPLE value on the TCP path
+bool acceptsValue(IOComponent::ValueKind kind, double v)
+{
+    switch (kind) {
+    case IOComponent::ValueKind::Bool:
+        return v == 0.0 || v == 1.0;
+    case IOComponent::ValueKind::Integer:
+        return std::isfinite(v) && std::trunc(v) == v;
+    case IOComponent::ValueKind::Real:
+        return std::isfinite(v);
+    case IOComponent::ValueKind::Unknown:
+        break;
+    }
+    return false;
+}
+
+} // namespace
+
+bool UdpIngestListener::decode(const uchar* data, int length, qint64 nowMs,
+                               SensorSampleBatch* out) const
+{
+    if (length < HeaderSize)
+        return false;
+
+    const int count = data[3];
+    if (qFromLittleEndian<quint16>(data) != Magic || data[2] != Version ||
+        count == 0 || length != HeaderSize + count * EntrySize)
+        return false;
+
+    const UnitID unitID = qFromLittleEndian<quint32>(data + 4);
+    const quint64 token = qFromLittleEndian<quint64>(data + 8);
+    qint64 baseMs       = qFromLittleEndian<qint64>(data + 16);
+    if (baseMs == 0)
+        baseMs = nowMs;
+    if (!isValidSampleTimestamp(baseMs))
+        return false;
+
+    UdpSessionTable::Session session;
+    if (!m_sessions->lookup(unitID, token, &session))
+        return false;
+
+    const int first = out->size();
+    const uchar* entry = data + HeaderSize;
+
+    for (int i = 0; i < count; ++i, entry += EntrySize) {
+        const quint16 index = qFromLittleEndian<quint16>(entry);
+        const qint32 offset = qFromLittleEndian<qint32>(entry + 4);
+        const quint64 bits  = qFromLittleEndian<quint64>(entry + 8);
+
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+
+        // baseMs is in range, so adding a 32-bit offset cannot overflow
+        if (index >= session.sensorKinds.size() ||
+            !isValidSampleTimestamp(baseMs + offset) ||
+            !acceptsValue(session.sensorKinds.at(index), value)) {
+            out->resize(first);
+            return false;
+        }
+
+        SensorSample s;
+        s.unitID = unitID;
+        s.sensorIndex = index;
+        s.timestampMs = baseMs + offset;
+        s.value = value;
+        out->append(s);
+    }
+
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+
+UdpIngestListener::UdpIngestListener(const UdpSessionTable* sessions, QObject* parent)
+    : QObject(parent)
+    , m_sessions(sessions)
+{
+}
+
+UdpIngestListener::~UdpIngestListener()
+{
+    stop();
+}
+
+bool UdpIngestListener::start(const QString& bindAddress, quint16 port, int threads)
+{
+    if (m_running)
+        return true;
+
+    for (int i = 0; i < qMax(1, threads); ++i) {
+        const int fd = openSocket(bindAddress, port);
+        if (fd < 0) {
+            for (int open : qAsConst(m_fds))
+                ::close(open);
+            m_fds.clear();
+            return false;
+        }
+        m_fds.append(fd);
+    }
+
+    m_port = port;
+    m_running = true;
+
+    for (int fd : qAsConst(m_fds)) {
+        QThread* thread = QThread::create([this, fd]() { receiveLoop(fd); });
+        thread->start();
+        m_threads.append(thread);
+    }
+
+    qDebug() << "[IoTropolisUdp] Listening on port" << port
+             << "with" << m_threads.size() << "receive threads";
+    return true;
+}
+
+void UdpIngestListener::stop()
+{
+    if (!m_running)
+        return;
+
+    // Receive threads notice within PollTimeoutMs
+    m_running = false;
+    for (QThread* thread : qAsConst(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+
+    for (int fd : qAsConst(m_fds))
+        ::close(fd);
+    m_fds.clear();
+}
+
+int UdpIngestListener::openSocket(const QString& bindAddress, quint16 port)
+{
+    const QHostAddress addr(bindAddress);
+    const bool anyAddress = bindAddress.isEmpty() ||
+                            addr == QHostAddress::AnyIPv4 ||
+                            addr == QHostAddress::AnyIPv6;
+    const bool ipv4 = !anyAddress && addr.protocol() == QAbstractSocket::IPv4Protocol;
+
+    const int fd = ::socket(ipv4 ? AF_INET : AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        qCritical() << "[IoTropolisUdp] socket failed:" << strerror(errno);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    // Absorb bursts while a receive thread is busy decoding
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    timeval tv{};
+    tv.tv_usec = PollTimeoutMs * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    int rc;
+    if (ipv4) {
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        sa.sin_addr.s_addr = htonl(addr.toIPv4Address());
+        rc = ::bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+    } else {
+        int zero = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+        sockaddr_in6 sa{};
+        sa.sin6_family = AF_INET6;
+        sa.sin6_port = htons(port);
+        if (anyAddress) {
+            sa.sin6_addr = in6addr_any;
+        } else {
+            const Q_IPV6ADDR a6 = addr.toIPv6Address();
+            std::memcpy(&sa.sin6_addr, &a6, sizeof(sa.sin6_addr));
+        }
+        rc = ::bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+    }
+
+    if (rc < 0) {
+        qCritical() << "[IoTropolisUdp] Failed to bind port" << port
+                    << ":" << strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void UdpIngestListener::receiveLoop(int fd)
+{
+    QByteArray buffers(RecvBatch * MaxDatagram, Qt::Uninitialized);
+    mmsghdr msgs[RecvBatch];
+    iovec iovs[RecvBatch];
+
+    SensorSampleBatch batch;
+    batch.reserve(RecvBatch * 8);
+
+    while (m_running.load(std::memory_order_relaxed)) {
+        std::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < RecvBatch; ++i) {
+            iovs[i].iov_base = buffers.data() + i * MaxDatagram;
+            iovs[i].iov_len = MaxDatagram;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // Blocks (up to SO_RCVTIMEO) for the first datagram only
+        const int n = recvmmsg(fd, msgs, RecvBatch, MSG_WAITFORONE, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+            qWarning() << "[IoTropolisUdp] recvmmsg failed:" << strerror(errno);
+            break;
+        }
+
+        const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+        quint64 dropped = 0;
+
+        for (int i = 0; i < n; ++i) {
+            const auto* data = reinterpret_cast<const uchar*>(iovs[i].iov_base);
+            if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ||
+                !decode(data, int(msgs[i].msg_len), nowMs, &batch))
+                ++dropped;
+        }
+
+        m_received.fetch_add(quint64(n), std::memory_order_relaxed);
+        if (dropped)
+            m_dropped.fetch_add(dropped, std::memory_order_relaxed);
+
+        if (!batch.isEmpty()) {
+            emit samplesReceived(batch);
+            batch.clear();
+        }
+    }
+}
+
+#else // !Q_OS_LINUX
+
+UdpIngestListener::UdpIngestListener(const UdpSessionTable* sessions, QObject* parent)
+    : QObject(parent), m_sessions(sessions) {}
+UdpIngestListener::~UdpIngestListener() = default;
+
+bool UdpIngestListener::start(const QString&, quint16, int)
+{
+    qCritical() << "[IoTropolisUdp] UDP ingest is only available on Linux";
+    return false;
+}
+
+void UdpIngestListener::stop() {}
+
+#endif // Q_OS_LINUX
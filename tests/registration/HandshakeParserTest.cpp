@@ -0,0 +1,329 @@
+// Compares HandshakeParser with the QJsonDocument-based HELLO/DESCRIBE
+// parsing it replaced, on malformed, escaped and duplicate-key payloads
+// plus deterministic mutations of them. Exits non-zero on any difference.
+//
+//   make test
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QDebug>
+
+#include "registration/HandshakeParser.h"
+
+namespace {
+
+struct Hello
+{
+    bool ok{false};
+    QString identity;
+    QString secret;
+
+    bool operator==(const Hello& o) const
+    {
+        return ok == o.ok && (!ok || (identity == o.identity && secret == o.secret));
+    }
+};
+
+struct Describe
+{
+    HandshakeParser::Result result{HandshakeParser::Result::Ok};
+    QString type;
+    QString subtype;
+    QStringList sensors;        // "name/format"
+    QStringList actuators;
+
+    // A unit with invalid components is dropped, so its lists never matter
+    bool operator==(const Describe& o) const
+    {
+        if (result != o.result || type != o.type || subtype != o.subtype)
+            return false;
+        return result != HandshakeParser::Result::Ok ||
+               (sensors == o.sensors && actuators == o.actuators);
+    }
+};
+
+// ------------------------------------------------------------
+// REFERENCE: the parsing IoTropolisUnitConnection did before
+// ------------------------------------------------------------
+Hello referenceHello(const QByteArray& data)
+{
+    const QJsonObject obj = QJsonDocument::fromJson(data).object();
+
+    Hello h;
+    h.ok = obj.value("version").toString() == "1.0";
+    if (h.ok) {
+        h.identity = obj.value("identity").toString();
+        h.secret   = obj.value("secret").toString();
+    }
+    return h;
+}
+
+bool referenceComponents(const QJsonArray& array, QStringList* out)
+{
+    for (const auto& val : array) {
+        bool ok = false;
+        const IOComponent c = IOComponent::fromJson(val.toObject(), &ok);
+        if (!ok)
+            return false;
+        out->append(c.name() + '/' + c.format());
+    }
+    return true;
+}
+
+Describe referenceDescribe(const QByteArray& data)
+{
+    const QJsonObject obj = QJsonDocument::fromJson(data).object();
+
+    Describe d;
+    d.type    = obj.value("type").toString();
+    d.subtype = obj.value("subtype").toString();
+    if (!referenceComponents(obj.value("sensors").toArray(), &d.sensors))
+        d.result = HandshakeParser::Result::InvalidSensor;
+    else if (!referenceComponents(obj.value("actuators").toArray(), &d.actuators))
+        d.result = HandshakeParser::Result::InvalidActuator;
+    return d;
+}
+
+// ------------------------------------------------------------
+// UNDER TEST
+// ------------------------------------------------------------
+Hello parsedHello(HandshakeParser& parser, const QByteArray& data)
+{
+    Hello h;
+    h.ok = parser.parseHello(data, &h.identity, &h.secret);
+    return h;
+}
+
+QStringList componentNames(const QList<IOComponent>& list)
+{
+    QStringList out;
+    for (const IOComponent& c : list)
+        out.append(c.name() + '/' + c.format());
+    return out;
+}
+
+Describe parsedDescribe(HandshakeParser& parser, const QByteArray& data)
+{
+    Describe d;
+    QList<IOComponent> sensors, actuators;
+    d.result = parser.parseDescribe(data, &d.type, &d.subtype, &sensors, &actuators);
+    d.sensors   = componentNames(sensors);
+    d.actuators = componentNames(actuators);
+    return d;
+}
+
+QDebug operator<<(QDebug dbg, const Hello& h)
+{
+    return dbg << "{ok" << h.ok << "identity" << h.identity << "secret" << h.secret << "}";
+}
+
+QDebug operator<<(QDebug dbg, const Describe& d)
+{
+    return dbg << "{result" << int(d.result) << "type" << d.type << "subtype" << d.subtype
+               << "sensors" << d.sensors << "actuators" << d.actuators << "}";
+}
+
+// ------------------------------------------------------------
+// INPUTS
+// ------------------------------------------------------------
+const char* const Malformed[] = {
+    "", "{}", "[]", "null", "\"x\"", "{", "}", "{{}}",
+    "{\"version\":\"1.0\"",
+    "{\"version\":\"1.0\"}}",
+    "{\"version\":\"1.0\",}",
+    "{,\"version\":\"1.0\"}",
+    "{\"version\" \"1.0\"}",
+    "{\"version\":}",
+    "{\"version\":\"1.0\"} x",
+    "{'version':'1.0'}",
+    "{version:\"1.0\"}",
+    "{\"version\":\"1.0\" \"identity\":\"a\"}",
+    "{\"version\":\"1.0\",\"identity\":\"a}",
+    "{\"version\":\"1.0\",\"identity\":[1,2}",
+    "{\"version\":\"1.0\",\"identity\":{\"a\" 1}}",
+    "\xEF\xBB\xBF{\"version\":\"1.0\",\"type\":\"t\"}",
+    " \xEF\xBB\xBF{\"version\":\"1.0\",\"type\":\"t\"}",
+    " \t{ \"version\" : \"1.0\" , \"type\" : \"t\" }\r ",
+    "{\"version\":\"1.0\"}\n",
+};
+
+const char* const Values[] = {
+    "0", "-0", "01", "1.", "-.5", ".5", "1e5", "1E+5", "1e-5", "1e", "1e+",
+    "-", "+1", "--1", "1e400", "-1e-400", "99999999999999999999", "0x10",
+    "1.5.2", "Infinity", "NaN", "true", "false", "null", "tru", "nul", "falsey",
+    "[]", "[1,]", "[,1]", "{}", "{\"a\":}", "{\"a\":1,}", "[[[]]]", "\"s\"",
+};
+
+const char* const Strings[] = {
+    "plain", "", " spaced ", "a\\\"b", "a\\\\b", "a\\/b", "\\b\\f\\n\\r\\t",
+    "\\u0041", "\\u00e9", "\\u20AC", "\\u20ac", "\\ud83d\\ude00", "\\uD83D\\uDE00",
+    "\\ud83d", "\\ude00", "\\ud83dx", "\\ude00\\ud83d", "\\ud83d\\ud83d\\ude00",
+    "\\ud83d\\u0041", "\\u0000", "a\\u0000b", "\\u00", "\\u00e", "\\uZZZZ", "\\u+123",
+    "\\x", "\\'", "\\a", "\\0", "\\U0041", "\\", "a\\",
+    "tab\there", "ctl\x01", "del\x7f",
+    "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xEF\xBF\xBE", "\xF4\x8F\xBF\xBF",
+    "\xC0\xAF", "\xC1\xBF", "\xE0\x80\xAF", "\xE0\x9F\xBF", "\xF0\x8F\xBF\xBF",
+    "\xED\xA0\x80", "\xED\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF8",
+    "\xFF", "\x80", "\xBF", "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xC3\x28", "\xE2\x28\xA1",
+    "\\\xC3\xA9", "\\\x80", "a\xC3\xA9\\u00e9\xE2\x82\xAC",
+};
+
+QList<QByteArray> payloads()
+{
+    QList<QByteArray> out;
+
+    for (const char* m : Malformed)
+        out.append(m);
+
+    for (const char* v : Values) {
+        const QByteArray value(v);
+        out.append("{\"x\":" + value + ",\"version\":\"1.0\",\"type\":\"t\"}");
+        out.append("{\"version\":\"1.0\",\"type\":\"t\",\"x\":" + value + "}");
+        out.append("{\"version\":" + value + ",\"identity\":" + value + ",\"type\":" + value + "}");
+        out.append("{\"sensors\":" + value + ",\"actuators\":[" + value + "]}");
+        out.append("{\"sensors\":[{\"name\":" + value + ",\"format\":\"f\"}]}");
+    }
+
+    for (const char* s : Strings) {
+        const QByteArray str = "\"" + QByteArray(s) + "\"";
+        out.append("{\"version\":\"1.0\",\"identity\":" + str + ",\"secret\":" + str + "}");
+        out.append("{\"version\":" + str + "}");
+        out.append("{" + str + ":1,\"version\":\"1.0\",\"type\":\"t\"}");
+        out.append("{\"type\":" + str + ",\"subtype\":" + str + "}");
+        out.append("{\"sensors\":[{\"name\":" + str + ",\"format\":" + str + "}],"
+                   "\"actuators\":[{\"name\":\"a\",\"format\":" + str + "}]}");
+    }
+
+    // Duplicate keys: the last one wins
+    const char* const duplicates[] = {
+        "{\"version\":\"2.0\",\"version\":\"1.0\"}",
+        "{\"version\":\"1.0\",\"version\":\"2.0\"}",
+        "{\"version\":\"1.0\",\"version\":1}",
+        "{\"version\":\"1.0\",\"identity\":\"a\",\"identity\":\"b\"}",
+        "{\"version\":\"1.0\",\"identity\":\"a\",\"identity\":5}",
+        "{\"version\":\"1.0\",\"secret\":\"a\",\"secret\":null}",
+        "{\"versio\\u006e\":\"1.0\"}",
+        "{\"version\":\"1.0\",\"versio\\u006e\":\"2.0\"}",
+        "{\"type\":\"a\",\"type\":\"b\"}",
+        "{\"type\":\"a\",\"type\":null}",
+        "{\"typ\\u0065\":\"a\",\"type\":\"b\"}",
+        "{\"type\":\"b\",\"typ\\u0065\":\"a\"}",
+        "{\"sensors\":[{\"name\":\"a\"}],\"sensors\":[{\"name\":\"b\",\"format\":\"f\"}]}",
+        "{\"sensors\":[{\"name\":\"b\",\"format\":\"f\"}],\"sensors\":[{\"name\":\"a\"}]}",
+        "{\"sensors\":[{\"name\":\"b\",\"format\":\"f\"}],\"sensors\":5}",
+        "{\"sensors\":[5],\"sensors\":{}}",
+        "{\"actuators\":[5],\"actuators\":[],\"sensors\":[{}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"name\":\"b\",\"format\":\"f\"}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\",\"name\":\"\"}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\",\"format\":7}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\",\"extra\":{\"name\":1}}]}",
+    };
+    for (const char* d : duplicates)
+        out.append(d);
+
+    // Components
+    const char* const components[] = {
+        "{\"type\":\"t\",\"subtype\":\"s\",\"sensors\":[{\"name\":\"a\",\"format\":\"float\"},"
+        "{\"name\":\"b\",\"format\":\"int16\"}],\"actuators\":[{\"name\":\"c\",\"format\":\"bool\"}]}",
+        "{\"sensors\":[],\"actuators\":[]}",
+        "{\"sensors\":[{}]}",
+        "{\"sensors\":[{\"name\":\"a\"}]}",
+        "{\"sensors\":[{\"format\":\"f\"}]}",
+        "{\"sensors\":[{\"name\":\"\",\"format\":\"f\"}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\"},5]}",
+        "{\"sensors\":[[]]}",
+        "{\"sensors\":[null]}",
+        "{\"sensors\":[\"a\"]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\"}],\"actuators\":[{\"name\":5,\"format\":\"f\"}]}",
+        "{\"sensors\":[{\"name\":\"a\"}],\"actuators\":[{\"name\":\"b\"}]}",
+        "{\"actuators\":[{\"name\":\"b\"}],\"sensors\":[{\"name\":\"a\"}]}",
+        "{\"sensors\":[{\"name\":\"a\",\"format\":\"f\"}] , \"type\" : \"t\" }",
+    };
+    for (const char* c : components)
+        out.append(c);
+
+    // Nesting around QJsonDocument's limit
+    for (int depth = 1020; depth <= 1026; ++depth) {
+        out.append("{\"x\":" + QByteArray(depth, '[') + QByteArray(depth, ']') +
+                   ",\"version\":\"1.0\",\"type\":\"t\"}");
+        QByteArray objects;
+        for (int i = 0; i < depth; ++i)
+            objects += "{\"a\":";
+        objects += "1" + QByteArray(depth, '}');
+        out.append("{\"version\":\"1.0\",\"type\":\"t\",\"x\":" + objects + "}");
+    }
+
+    return out;
+}
+
+// Byte-level mutations of a payload: flip, insert and delete
+QByteArray mutate(QByteArray data, QRandomGenerator& rng)
+{
+    static const char alphabet[] = "{}[]\":,\\u0123abdefnrtlsE.-+ \t\x01\x80\xBF\xC3\xE2\xED\xF0\xFF";
+
+    const int edits = 1 + rng.bounded(3);
+    for (int i = 0; i < edits; ++i) {
+        const char c = alphabet[rng.bounded(int(sizeof(alphabet) - 1))];
+        const int at = data.isEmpty() ? 0 : rng.bounded(int(data.size()));
+        switch (rng.bounded(3)) {
+        case 0:
+            if (!data.isEmpty())
+                data[at] = c;
+            break;
+        case 1:
+            data.insert(at, c);
+            break;
+        default:
+            if (!data.isEmpty())
+                data.remove(at, 1);
+            break;
+        }
+    }
+    return data;
+}
+
+} // namespace
+
+int main()
+{
+    constexpr int MutationsPerPayload = 200;
+
+    HandshakeParser parser;
+    QRandomGenerator rng(20261019);
+
+    int cases = 0;
+    int failures = 0;
+
+    auto check = [&](const QByteArray& data) {
+        ++cases;
+
+        const Hello helloRef = referenceHello(data);
+        const Hello hello = parsedHello(parser, data);
+        if (!(hello == helloRef)) {
+            ++failures;
+            qWarning().nospace() << "HELLO " << data << "\n  QJsonDocument: " << helloRef
+                                 << "\n  HandshakeParser: " << hello;
+        }
+
+        const Describe describeRef = referenceDescribe(data);
+        const Describe describe = parsedDescribe(parser, data);
+        if (!(describe == describeRef)) {
+            ++failures;
+            qWarning().nospace() << "DESCRIBE " << data << "\n  QJsonDocument: " << describeRef
+                                 << "\n  HandshakeParser: " << describe;
+        }
+    };
+
+    const QList<QByteArray> inputs = payloads();
+    for (const QByteArray& data : inputs) {
+        check(data);
+        for (int i = 0; i < MutationsPerPayload; ++i)
+            check(mutate(data, rng));
+    }
+
+    qInfo().noquote() << cases << "payloads," << failures << "differences";
+    return failures == 0 ? 0 : 1;
+}
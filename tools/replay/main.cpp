@@ -0,0 +1,477 @@
+// iotropolis-replay: replays a unit session capture against a server.
+//
+//   iotropolis-replay [--host 127.0.0.1] [--port 12345] [--speed 1|N|max]
+//                     [--reply-timeout ms] [--secrets file] <capture file>
+//
+// Each captured session gets its own connection, opened at its recorded
+// offset and fed its inbound lines in order at their recorded offsets
+// (scaled by --speed; "max" sends as fast as the socket accepts). The
+// replies recorded after each inbound line are what the replay waits for
+// to measure latency.
+//
+// Captures hold no identity secrets. A HELLO is sent with the secret of its
+// identity taken from --secrets ("<identity> <secret>" per line) or learned
+// from a HELLO_ACK earlier in the replay; without one the secret is left
+// out, which a server that does not know the identity yet accepts.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QTimer>
+#include <QVector>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "capture/CaptureFormat.h"
+
+namespace {
+
+struct Step
+{
+    quint64 timeUs{0};
+    QByteArray line;
+    int expectedReplies{0};
+};
+
+struct SessionScript
+{
+    quint32 id{0};
+    quint64 openUs{0};
+    quint64 closeUs{0};
+    bool closed{false};
+    QVector<Step> steps;
+};
+
+struct ReplayStats
+{
+    int sessions{0};
+    int connectFailures{0};
+    quint64 linesSent{0};
+    quint64 bytesSent{0};
+    quint64 replies{0};
+    quint64 unexpectedReplies{0};
+    quint64 missingReplies{0};
+    QVector<qint64> latenciesUs;
+};
+
+bool loadCapture(const QString& path, QVector<SessionScript>* scripts, QString* error)
+{
+    CaptureFormat::Reader reader;
+    if (!reader.open(path)) {
+        *error = reader.errorString();
+        return false;
+    }
+
+    QHash<quint32, int> index;
+    CaptureFormat::Record r;
+
+    while (reader.next(&r)) {
+        auto it = index.constFind(r.session);
+        if (it == index.constEnd()) {
+            SessionScript s;
+            s.id = r.session;
+            s.openUs = r.timeUs;
+            it = index.insert(r.session, scripts->size());
+            scripts->append(s);
+        }
+        SessionScript& s = (*scripts)[it.value()];
+
+        switch (r.kind) {
+        case CaptureFormat::RecordKind::Open:
+            s.openUs = r.timeUs;
+            break;
+        case CaptureFormat::RecordKind::Inbound:
+            s.steps.append({r.timeUs, r.payload, 0});
+            break;
+        case CaptureFormat::RecordKind::Outbound:
+            if (!s.steps.isEmpty())
+                ++s.steps.last().expectedReplies;
+            break;
+        case CaptureFormat::RecordKind::Close:
+            s.closeUs = r.timeUs;
+            s.closed = true;
+            break;
+        }
+    }
+
+    if (!reader.errorString().isEmpty()) {
+        *error = reader.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool loadSecrets(const QString& path, QHash<QString, QString>* secrets, QString* error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().simplified().split(' ');
+        if (fields.size() == 2)
+            secrets->insert(QString::fromUtf8(fields.at(0)), QString::fromUtf8(fields.at(1)));
+    }
+    return true;
+}
+
+// JSON object of a "<COMMAND> {...}" line, if it is that command
+bool commandObject(const QByteArray& line, const char* command, QJsonObject* obj)
+{
+    const QByteArray prefix = QByteArray(command) + ' ';
+    if (!line.startsWith(prefix))
+        return false;
+    const QJsonDocument doc = QJsonDocument::fromJson(line.mid(prefix.size()));
+    if (!doc.isObject())
+        return false;
+    *obj = doc.object();
+    return true;
+}
+
+class Replay;
+
+// One captured session replayed over its own connection
+class ReplaySession : public QObject
+{
+public:
+    ReplaySession(const SessionScript* script, Replay* replay)
+        : m_script(script), m_replay(replay) {}
+
+    void start(const QString& host, quint16 port);
+
+private:
+    struct Pending
+    {
+        qint64 sentNs;
+        int remaining;
+    };
+
+    QByteArray withSecret(const QByteArray& line);
+    void sendDue();
+    void onLine();
+    void maybeFinish();
+    void finish();
+
+    const SessionScript* m_script;
+    Replay* m_replay;
+    QTcpSocket m_socket;
+    QTimer m_sendTimer;         // next captured line is due
+    QTimer m_finishTimer;       // reply timeout, then the recorded close
+    int m_next{0};
+    std::deque<Pending> m_pending;
+    QString m_identity;         // sent in this session's HELLO
+    bool m_connected{false};
+    bool m_done{false};
+};
+
+class Replay
+{
+public:
+    Replay(QVector<SessionScript> scripts, double speed, int replyTimeoutMs,
+           QHash<QString, QString> secrets)
+        : m_scripts(std::move(scripts)), m_speed(speed), m_replyTimeoutMs(replyTimeoutMs)
+        , m_secrets(std::move(secrets))
+    {
+        for (const auto& s : m_scripts)
+            m_originUs = qMin(m_originUs, s.openUs);
+    }
+
+    void run(const QString& host, quint16 port)
+    {
+        m_clock.start();
+        m_active = m_scripts.size();
+        m_stats.sessions = m_scripts.size();
+
+        if (m_active == 0) {
+            report();
+            QCoreApplication::quit();
+            return;
+        }
+
+        for (const auto& script : qAsConst(m_scripts)) {
+            auto session = std::make_unique<ReplaySession>(&script, this);
+            ReplaySession* raw = session.get();
+            m_sessions.push_back(std::move(session));
+
+            QTimer::singleShot(int(delayUs(script.openUs) / 1000), raw,
+                               [raw, host, port]() { raw->start(host, port); });
+        }
+    }
+
+    // Microseconds from now until a captured instant is due
+    qint64 delayUs(quint64 captureUs) const
+    {
+        if (m_speed <= 0)
+            return 0;
+        const qint64 dueUs = qint64(double(captureUs - m_originUs) / m_speed);
+        return qMax<qint64>(0, dueUs - nowNs() / 1000);
+    }
+
+    qint64 nowNs() const { return m_clock.nsecsElapsed(); }
+    int replyTimeoutMs() const { return m_replyTimeoutMs; }
+    ReplayStats& stats() { return m_stats; }
+
+    // Identity secrets given up front or issued during this replay
+    QString secretFor(const QString& identity) const { return m_secrets.value(identity); }
+    void learnSecret(const QString& identity, const QString& secret)
+    {
+        m_secrets.insert(identity, secret);
+    }
+
+    void sessionFinished()
+    {
+        if (--m_active == 0) {
+            report();
+            QCoreApplication::quit();
+        }
+    }
+
+private:
+    void report()
+    {
+        const double elapsed = qMax(1e-9, double(nowNs()) / 1e9);
+        QVector<qint64>& lat = m_stats.latenciesUs;
+        std::sort(lat.begin(), lat.end());
+
+        auto pct = [&lat](double p) -> qint64 {
+            if (lat.isEmpty())
+                return 0;
+            return lat.at(qMin(lat.size() - 1, int(p * lat.size())));
+        };
+
+        QTextStream out(stdout);
+        out << "sessions      " << m_stats.sessions
+            << " (connect failures " << m_stats.connectFailures << ")\n"
+            << "lines sent    " << m_stats.linesSent
+            << " (" << m_stats.bytesSent << " bytes)\n"
+            << "replies       " << m_stats.replies
+            << " (unexpected " << m_stats.unexpectedReplies
+            << ", missing " << m_stats.missingReplies << ")\n"
+            << "elapsed       " << QString::number(elapsed, 'f', 3) << " s\n"
+            << "throughput    " << QString::number(m_stats.linesSent / elapsed, 'f', 1)
+            << " lines/s, " << QString::number(m_stats.bytesSent / elapsed / 1e6, 'f', 3)
+            << " MB/s\n"
+            << "latency us    p50 " << pct(0.50) << "  p90 " << pct(0.90)
+            << "  p99 " << pct(0.99) << "  max " << (lat.isEmpty() ? 0 : lat.last())
+            << " (" << lat.size() << " samples)\n";
+    }
+
+    QVector<SessionScript> m_scripts;
+    std::vector<std::unique_ptr<ReplaySession>> m_sessions;
+    double m_speed;
+    int m_replyTimeoutMs;
+    quint64 m_originUs{~quint64(0)};
+    QElapsedTimer m_clock;
+    int m_active{0};
+    ReplayStats m_stats;
+    QHash<QString, QString> m_secrets;
+};
+
+void ReplaySession::start(const QString& host, quint16 port)
+{
+    m_sendTimer.setSingleShot(true);
+    m_finishTimer.setSingleShot(true);
+    QObject::connect(&m_sendTimer, &QTimer::timeout, this, [this]() { sendDue(); });
+    QObject::connect(&m_finishTimer, &QTimer::timeout, this, [this]() { finish(); });
+
+    QObject::connect(&m_socket, &QTcpSocket::connected, this, [this]() {
+        m_connected = true;
+        sendDue();
+    });
+    QObject::connect(&m_socket, &QTcpSocket::readyRead, this, [this]() { onLine(); });
+    QObject::connect(&m_socket, &QTcpSocket::disconnected, this, [this]() { finish(); });
+    auto onError = [this]() {
+        if (!m_connected && !m_done) {
+            ++m_replay->stats().connectFailures;
+            finish();
+        }
+    };
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    QObject::connect(&m_socket, &QAbstractSocket::errorOccurred, this, onError);
+#else
+    QObject::connect(&m_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
+                     this, onError);
+#endif
+
+    m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_socket.connectToHost(host, port);
+}
+
+void ReplaySession::sendDue()
+{
+    ReplayStats& stats = m_replay->stats();
+    const QVector<Step>& steps = m_script->steps;
+
+    while (m_next < steps.size()) {
+        const Step& step = steps.at(m_next);
+
+        const qint64 waitUs = m_replay->delayUs(step.timeUs);
+        if (waitUs > 0) {
+            m_sendTimer.start(int(qMax<qint64>(1, waitUs / 1000)));
+            return;
+        }
+
+        const QByteArray line = withSecret(step.line);
+        m_socket.write(line + "\n");
+        ++stats.linesSent;
+        stats.bytesSent += quint64(line.size() + 1);
+
+        if (step.expectedReplies > 0)
+            m_pending.push_back({m_replay->nowNs(), step.expectedReplies});
+        ++m_next;
+    }
+
+    maybeFinish();
+}
+
+// Captured HELLOs carry a placeholder where the unit sent its secret
+QByteArray ReplaySession::withSecret(const QByteArray& line)
+{
+    QJsonObject hello;
+    if (!commandObject(line, "HELLO", &hello))
+        return line;
+
+    m_identity = hello.value("identity").toString();
+    if (hello.value("secret").toString() != QLatin1String(CaptureFormat::SecretPlaceholder))
+        return line;
+
+    const QString secret = m_replay->secretFor(m_identity);
+    if (secret.isEmpty())
+        hello.remove("secret");
+    else
+        hello.insert("secret", secret);
+    return "HELLO " + QJsonDocument(hello).toJson(QJsonDocument::Compact);
+}
+
+void ReplaySession::onLine()
+{
+    ReplayStats& stats = m_replay->stats();
+
+    while (m_socket.canReadLine()) {
+        const QByteArray reply = m_socket.readLine().trimmed();
+        ++stats.replies;
+
+        // A secret issued now is the one later sessions must present
+        QJsonObject ack;
+        if (!m_identity.isEmpty() && commandObject(reply, "HELLO_ACK", &ack) &&
+            ack.contains("identity_secret"))
+            m_replay->learnSecret(m_identity, ack.value("identity_secret").toString());
+
+        if (m_pending.empty()) {
+            ++stats.unexpectedReplies;
+            continue;
+        }
+
+        Pending& head = m_pending.front();
+        if (--head.remaining == 0) {
+            stats.latenciesUs.append((m_replay->nowNs() - head.sentNs) / 1000);
+            m_pending.pop_front();
+        }
+    }
+
+    maybeFinish();
+}
+
+void ReplaySession::maybeFinish()
+{
+    if (m_done || m_next < m_script->steps.size())
+        return;
+
+    if (!m_pending.empty()) {
+        // Give outstanding replies a bounded time to arrive
+        if (!m_finishTimer.isActive())
+            m_finishTimer.start(m_replay->replyTimeoutMs());
+        return;
+    }
+
+    // Hold the connection open until its recorded close
+    const qint64 waitUs = m_script->closed ? m_replay->delayUs(m_script->closeUs) : 0;
+    m_finishTimer.start(int(waitUs / 1000));
+}
+
+void ReplaySession::finish()
+{
+    if (m_done)
+        return;
+    m_done = true;
+    m_sendTimer.stop();
+    m_finishTimer.stop();
+
+    ReplayStats& stats = m_replay->stats();
+    for (const Pending& p : m_pending)
+        stats.missingReplies += quint64(p.remaining);
+    m_pending.clear();
+
+    m_socket.disconnect(this);
+    m_socket.abort();
+    m_replay->sessionFinished();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("iotropolis-replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replay an IoTropolis unit session capture");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Capture file written by the server");
+
+    QCommandLineOption hostOpt({"H", "host"}, "Server address", "host", "127.0.0.1");
+    QCommandLineOption portOpt({"p", "port"}, "Server TCP port", "port", "12345");
+    QCommandLineOption speedOpt({"s", "speed"}, "Time scale: 1, N or max", "speed", "1");
+    QCommandLineOption timeoutOpt("reply-timeout", "Wait for outstanding replies (ms)",
+                                  "ms", "5000");
+    QCommandLineOption secretsOpt("secrets", "Identity secrets, \"<identity> <secret>\" per line",
+                                  "file");
+    parser.addOptions({hostOpt, portOpt, speedOpt, timeoutOpt, secretsOpt});
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+        parser.showHelp(1);
+
+    double speed = 0;
+    const QString speedArg = parser.value(speedOpt).toLower();
+    if (speedArg != "max") {
+        bool ok = false;
+        speed = speedArg.toDouble(&ok);
+        if (!ok || speed <= 0) {
+            QTextStream(stderr) << "Invalid speed: " << speedArg << "\n";
+            return 1;
+        }
+    }
+
+    QVector<SessionScript> scripts;
+    QString error;
+    if (!loadCapture(args.first(), &scripts, &error)) {
+        QTextStream(stderr) << "Cannot read capture " << args.first() << ": " << error << "\n";
+        return 1;
+    }
+
+    QHash<QString, QString> secrets;
+    if (parser.isSet(secretsOpt) && !loadSecrets(parser.value(secretsOpt), &secrets, &error)) {
+        QTextStream(stderr) << "Cannot read secrets " << parser.value(secretsOpt) << ": " << error << "\n";
+        return 1;
+    }
+
+    Replay replay(std::move(scripts), speed, parser.value(timeoutOpt).toInt(), std::move(secrets));
+    QTimer::singleShot(0, &app, [&]() {
+        replay.run(parser.value(hostOpt), quint16(parser.value(portOpt).toUInt()));
+    });
+
+    return app.exec();
+}